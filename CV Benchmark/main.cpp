@@ -0,0 +1,993 @@
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <limits>
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "../CV Lab 2/Inspection.cpp"
+#include "../CV Lab 3/Recognition.cpp"
+#include "../CV Lab 3/PageIndex.cpp"
+#include "../CV Lab 4/Detector.cpp"
+#include "../CV Lab 4/FrameSource.cpp"
+#include "../CV Common/Utilities.cpp"
+#include "../CV Common/ResultCache.cpp"
+
+using namespace cv;
+using namespace std;
+
+#define GLUEIMG			"Glue"
+#define SYNTH_WIDTH		640
+#define SYNTH_HEIGHT	480
+#define SYNTH_FRAMES	300
+#define SYNTH_SEED		4052
+#define DEFAULT_TOLERANCE	10.0
+#define DISTRACTOR_SEED	4053
+#define STREAM_FRAMES_PER_PAGE	25
+
+// latency statistics for one stage of a benchmark, in microseconds
+struct StageResult {
+	string name;
+	int64 count;
+	double mean;
+	int64 p50;
+	int64 p95;
+	int64 p99;
+	int64 max;
+};
+
+// the outcome of running one pipeline over its data set
+struct BenchmarkResult {
+	string name;
+	int images;
+	double seconds;
+	long peak_rss;
+	vector<StageResult> stages;
+	// any other measurements, written out alongside the standard ones
+	map<string, double> metrics;
+
+	double imagesPerSecond() {
+		return (seconds > 0) ? images / seconds : 0;
+	}
+};
+
+/**
+ gets the peak resident set size of this process so far. this only ever grows,
+ which is why each benchmark is run in its own process (see runInChild), so
+ that the peak is that benchmark's rather than the largest of all of the
+ benchmarks run before it
+
+ @return peak resident set size in bytes
+ */
+long getPeakRSS() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return (long)usage.ru_maxrss;
+#else
+	return (long)usage.ru_maxrss * 1024;
+#endif
+}
+
+// copy the per-stage latency histograms out of a timer
+vector<StageResult> getStageResults(Timestamper& timer) {
+	vector<StageResult> stages;
+	for (int i = 0; i < timer.getEventCount(); i++) {
+		TimestampEvent event = timer.getEvent(i);
+		LatencyHistogram& h = event.getHistogram();
+		if (h.getCount() == 0)
+			continue;
+		StageResult s;
+		s.name = event.getEventName();
+		s.count = h.getCount();
+		s.mean = h.getMean();
+		s.p50 = h.getValueAtPercentile(50.0);
+		s.p95 = h.getValueAtPercentile(95.0);
+		s.p99 = h.getValueAtPercentile(99.0);
+		s.max = h.getMaximum();
+		stages.push_back(s);
+	}
+	return stages;
+}
+
+/**
+ runs the Lab 2 glue bottle inspection over every GlueN.jpg image
+
+ @param dir the Lab 2 image directory
+ @param repeat how many times to process the whole data set
+ */
+BenchmarkResult benchmarkGlueInspection(string dir, int repeat) {
+	BenchmarkResult result;
+	result.name = "lab2_glue_inspection";
+	result.images = 0;
+	result.seconds = 0;
+
+	Timestamper timer;
+	int load_event = timer.registerEvent("Load");
+	for (int r = 0; r < repeat; r++) {
+		for (int i = 1; ; i++) {
+			timer.ignoreTimeSinceLastRecorded();
+			int64 start = getTickCount();
+			Mat img = imread(dir+"/"+GLUEIMG+to_string(i)+".jpg");
+			if (img.empty())
+				break;
+			timer.recordTime(load_event);
+
+			vector<Rect> bounds;
+			vector<double> ratios;
+			inspectBottles(img, bounds, ratios, &timer);
+			result.seconds += (getTickCount() - start) / getTickFrequency();
+			result.images++;
+		}
+	}
+	result.stages = getStageResults(timer);
+	result.peak_rss = getPeakRSS();
+	return result;
+}
+
+/**
+ runs the Lab 2 glue bottle inspection in strips of rows over every
+ GlueN.jpg image, each converted to a binary PPM first so that the strips are
+ read straight from the file. the agreement is the fraction of images where
+ the strips find the same bottles and ratios as the whole-image inspection
+
+ @param dir the Lab 2 image directory
+ @param repeat how many times to process the whole data set
+ @param scratch_file where to write the PPM copy of each image
+ */
+BenchmarkResult benchmarkGlueStrips(string dir, int repeat, string scratch_file) {
+	BenchmarkResult result;
+	result.name = "lab2_glue_strips";
+	result.images = 0;
+	result.seconds = 0;
+
+	Timestamper timer;
+	timer.registerEvent("Midpoints");
+	timer.registerEvent("Bounds");
+	timer.registerEvent("Ratios");
+	int agreements = 0, inspected = 0;
+	for (int i = 1; ; i++) {
+		Mat img = imread(dir+"/"+GLUEIMG+to_string(i)+".jpg");
+		if (img.empty())
+			break;
+		vector<Rect> expected_bounds, bounds;
+		vector<double> expected_ratios, ratios;
+		inspectBottles(img, expected_bounds, expected_ratios);
+		imwrite(scratch_file, img);
+		for (int r = 0; r < repeat; r++) {
+			timer.ignoreTimeSinceLastRecorded();
+			int64 start = getTickCount();
+			inspectBottlesInStrips(scratch_file, bounds, ratios, &timer);
+			result.seconds += (getTickCount() - start) / getTickFrequency();
+			result.images++;
+		}
+		bool same = bounds == expected_bounds && ratios.size() == expected_ratios.size();
+		for (int j = 0; same && j < ratios.size(); j++)
+			same = fabs(ratios[j] - expected_ratios[j]) < 1e-9;
+		if (same)
+			agreements++;
+		inspected++;
+	}
+	remove(scratch_file.c_str());
+	result.stages = getStageResults(timer);
+	if (inspected > 0)
+		result.metrics["strip_agreement"] = (double) agreements / inspected;
+	result.peak_rss = getPeakRSS();
+	return result;
+}
+
+/**
+ runs the Lab 2 glue bottle inspection through an in-memory result cache: the
+ first pass over the GlueN.jpg images inspects them and stores the results,
+ and every later pass is answered by hashing the files. the Lookup stage is
+ the time taken to answer a duplicate
+
+ @param dir the Lab 2 image directory
+ @param repeat how many times to look up the whole data set after the first pass
+ */
+BenchmarkResult benchmarkResultCache(string dir, int repeat) {
+	BenchmarkResult result;
+	result.name = "lab2_result_cache";
+	result.images = 0;
+	result.seconds = 0;
+
+	Timestamper timer;
+	int lookup_event = timer.registerEvent("Lookup");
+	int inspect_event = timer.registerEvent("Inspect");
+	ResultCache cache(getInspectionVersion());
+	for (int r = 0; r <= repeat; r++) {
+		for (int i = 1; ; i++) {
+			string filename = dir+"/"+GLUEIMG+to_string(i)+".jpg";
+			timer.ignoreTimeSinceLastRecorded();
+			int64 start = getTickCount();
+			uint64 file_hash;
+			if (!HashFile(filename, file_hash))
+				break;
+			vector<Rect> bounds;
+			vector<double> ratios;
+			bool cached = getCachedInspection(cache, file_hash, bounds, ratios);
+			timer.recordTime(lookup_event);
+			if (!cached) {
+				Mat img = imread(filename);
+				inspectBottles(img, bounds, ratios);
+				cacheInspection(cache, file_hash, bounds, ratios);
+				timer.recordTime(inspect_event);
+			}
+			result.seconds += (getTickCount() - start) / getTickFrequency();
+			result.images++;
+		}
+	}
+	result.stages = getStageResults(timer);
+	if (result.images > 0)
+		result.metrics["cache_hit_rate"] = (double) cache.getHits() / result.images;
+	result.peak_rss = getPeakRSS();
+	return result;
+}
+
+/**
+ runs the Lab 3 page recognition over every BookViewN.jpg image
+
+ @param dir the Lab 3 image directory
+ @param repeat how many times to process the whole data set
+ */
+BenchmarkResult benchmarkPageRecognition(string dir, int repeat) {
+	BenchmarkResult result;
+	result.name = "lab3_page_recognition";
+	result.images = 0;
+	result.seconds = 0;
+
+	Timestamper timer;
+	int templates_event = timer.registerEvent("Templates");
+	int load_event = timer.registerEvent("Load");
+	int page_event = timer.registerEvent("Page");
+	int match_event = timer.registerEvent("Match");
+
+	Mat bluePixels = imread(dir+"/BlueBookPixelsNew.png");
+	if (bluePixels.empty()) {
+		cout << "Could not read the Lab 3 images in " << dir << endl;
+		result.peak_rss = getPeakRSS();
+		return result;
+	}
+	cvtColor(bluePixels, bluePixels, CV_BGR2HLS);
+	ColourHistogram h = ColourHistogram(bluePixels, 4);
+	timer.ignoreTimeSinceLastRecorded();
+	vector<pair<Mat, Mat>> templates = getTemplateImages(dir, h);
+	timer.recordTime(templates_event);
+
+	// one warper for the whole run, as with a fixed camera
+	PageWarper warper;
+	Mat gray, edge;
+	for (int r = 0; r < repeat; r++) {
+		for (int i = 1; ; i++) {
+			timer.ignoreTimeSinceLastRecorded();
+			int64 start = getTickCount();
+			Mat img = readBookImage(dir+"/"+BOOKIMG+to_string(i)+".jpg");
+			if (img.empty())
+				break;
+			timer.recordTime(load_event);
+
+			warper.warpToEdges(img, findPageCorners(img, h), gray, edge);
+			timer.recordTime(page_event);
+			matchEdgeImage(edge, templates);
+			timer.recordTime(match_event);
+			result.seconds += (getTickCount() - start) / getTickFrequency();
+			result.images++;
+		}
+	}
+	result.stages = getStageResults(timer);
+	result.metrics["warp_maps_built"] = warper.getMapsBuilt();
+	result.peak_rss = getPeakRSS();
+	return result;
+}
+
+/**
+ runs the Lab 3 page tracker over a simulated document camera video, in which
+ each BookViewN.jpg image is held for STREAM_FRAMES_PER_PAGE frames with a
+ slight drift. the fractions of frames that needed segmentation and matching
+ show how much of the still pipeline the tracking avoids, and the agreement is
+ the fraction of frames where the tracker finds the same page as the still
+ pipeline does for that image
+
+ @param dir the Lab 3 image directory
+ @param repeat how many times to process the whole data set
+ */
+BenchmarkResult benchmarkPageStream(string dir, int repeat) {
+	BenchmarkResult result;
+	result.name = "lab3_page_stream";
+	result.images = 0;
+	result.seconds = 0;
+
+	Timestamper timer;
+	int frame_event = timer.registerEvent("Frame");
+
+	Mat bluePixels = imread(dir+"/BlueBookPixelsNew.png");
+	if (bluePixels.empty()) {
+		cout << "Could not read the Lab 3 images in " << dir << endl;
+		result.peak_rss = getPeakRSS();
+		return result;
+	}
+	cvtColor(bluePixels, bluePixels, CV_BGR2HLS);
+	ColourHistogram h = ColourHistogram(bluePixels, 4);
+	vector<pair<Mat, Mat>> templates = getTemplateImages(dir, h);
+
+	int agreements = 0;
+	PageTracker tracker(h);
+	PageWarper warper;
+	Mat gray, edge, frame;
+	for (int r = 0; r < repeat; r++) {
+		for (int i = 1; ; i++) {
+			Mat img = readBookImage(dir+"/"+BOOKIMG+to_string(i)+".jpg");
+			if (img.empty())
+				break;
+			warper.warpToEdges(img, findPageCorners(img, h), gray, edge);
+			int expected = matchEdgeImage(edge, templates);
+			for (int f = 0; f < STREAM_FRAMES_PER_PAGE; f++) {
+				// a slow drift of up to a couple of pixels, as from a camera
+				// which is knocked slightly
+				Mat shift = Mat::eye(2, 3, CV_64F);
+				shift.at<double>(0, 2) = 0.1*f;
+				shift.at<double>(1, 2) = 0.05*f;
+				warpAffine(img, frame, shift, img.size());
+				timer.ignoreTimeSinceLastRecorded();
+				int64 start = getTickCount();
+				int match = tracker.processFrame(frame, templates);
+				timer.recordTime(frame_event);
+				result.seconds += (getTickCount() - start) / getTickFrequency();
+				result.images++;
+				if (match == expected)
+					agreements++;
+			}
+		}
+	}
+	result.stages = getStageResults(timer);
+	if (result.images > 0) {
+		result.metrics["segmented_fraction"] = (double) tracker.getSegmentations() / result.images;
+		result.metrics["matched_fraction"] = (double) tracker.getMatches() / result.images;
+		result.metrics["stream_agreement"] = (double) agreements / result.images;
+	}
+	result.peak_rss = getPeakRSS();
+	return result;
+}
+
+/**
+ renders a deterministic page-sized image of random text and boxes, used to
+ pad the page index out to a large catalogue
+
+ @param rng the generator, seeded once for the whole catalogue
+ @return the distractor page
+ */
+Mat renderDistractorPage(RNG& rng) {
+	Mat page(PAGEHEIGHT, PAGEWIDTH, CV_8UC3, Scalar(235, 235, 235));
+	for (int line = 0; line < 20; line++) {
+		string text;
+		for (int c = rng.uniform(5, 25); c > 0; c--)
+			text += (char) rng.uniform('a', 'z'+1);
+		putText(page, text, Point(rng.uniform(0, PAGEWIDTH/2), rng.uniform(20, PAGEHEIGHT)),
+				FONT_HERSHEY_PLAIN, rng.uniform(0.8, 2.0), Scalar::all(rng.uniform(0, 100)), 1);
+	}
+	for (int box = 0; box < 4; box++) {
+		Point corner(rng.uniform(0, PAGEWIDTH), rng.uniform(0, PAGEHEIGHT));
+		rectangle(page, corner, corner+Point(rng.uniform(10, 100), rng.uniform(10, 100)),
+				  Scalar(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256)), -1);
+	}
+	return page;
+}
+
+/**
+ runs the Lab 3 page retrieval with the local-feature index over every
+ BookViewN.jpg image, with the index optionally padded out with synthetic
+ distractor pages to show how the query time grows with the catalogue. the
+ agreement is the fraction of images where the index finds the same page as
+ the edge correlation
+
+ @param dir the Lab 3 image directory
+ @param repeat how many times to process the whole data set
+ @param catalogue number of distractor pages to add to the 13 real ones
+ */
+BenchmarkResult benchmarkPageIndex(string dir, int repeat, int catalogue) {
+	BenchmarkResult result;
+	result.name = "lab3_page_index";
+	if (catalogue > 0)
+		result.name += "_" + to_string(catalogue);
+	result.images = 0;
+	result.seconds = 0;
+
+	Timestamper timer;
+	int build_event = timer.registerEvent("Build");
+	int load_event = timer.registerEvent("Load");
+	int query_event = timer.registerEvent("Query");
+
+	Mat bluePixels = imread(dir+"/BlueBookPixelsNew.png");
+	if (bluePixels.empty()) {
+		cout << "Could not read the Lab 3 images in " << dir << endl;
+		result.peak_rss = getPeakRSS();
+		return result;
+	}
+	cvtColor(bluePixels, bluePixels, CV_BGR2HLS);
+	ColourHistogram h = ColourHistogram(bluePixels, 4);
+	vector<pair<Mat, Mat>> templates = getTemplateImages(dir, h);
+	timer.ignoreTimeSinceLastRecorded();
+
+	// the vocabulary is trained on the real pages only
+	PageIndex index;
+	vector<Mat> pages;
+	for (int i = 0; i < templates.size(); i++)
+		pages.push_back(templates[i].first);
+	index.train(pages);
+	for (int i = 0; i < pages.size(); i++)
+		index.addPage(pages[i]);
+	RNG rng(DISTRACTOR_SEED);
+	for (int i = 0; i < catalogue; i++)
+		index.addPage(renderDistractorPage(rng));
+	timer.recordTime(build_event);
+
+	int agreements = 0, queries = 0;
+	PageWarper warper;
+	Mat gray, edge;
+	for (int r = 0; r < repeat; r++) {
+		for (int i = 1; ; i++) {
+			timer.ignoreTimeSinceLastRecorded();
+			int64 start = getTickCount();
+			Mat img = readBookImage(dir+"/"+BOOKIMG+to_string(i)+".jpg");
+			if (img.empty())
+				break;
+			timer.recordTime(load_event);
+
+			int match = index.query(img);
+			timer.recordTime(query_event);
+			result.seconds += (getTickCount() - start) / getTickFrequency();
+			result.images++;
+
+			// the reference answer isn't part of the timing
+			warper.warpToEdges(img, findPageCorners(img, h), gray, edge);
+			if (match == matchEdgeImage(edge, templates))
+				agreements++;
+			queries++;
+			timer.ignoreTimeSinceLastRecorded();
+		}
+	}
+	result.stages = getStageResults(timer);
+	result.metrics["index_agreement"] = (queries > 0) ? (double) agreements / queries : 0;
+	result.peak_rss = getPeakRSS();
+	return result;
+}
+
+/**
+ renders one frame of a deterministic synthetic surveillance scene: a static
+ textured background with sensor noise, a 'person' walking across it, and a
+ 'bag' that is left behind a third of the way through the sequence
+
+ @param background the static scene
+ @param frame_number index of the frame to render
+ @param frame output frame
+ */
+void renderSyntheticFrame(Mat& background, int frame_number, Mat& frame) {
+	background.copyTo(frame);
+	addGaussianNoise(frame, 0.0, 4.0);
+
+	int drop_frame = SYNTH_FRAMES / 3;
+	int x = (frame_number * frame.cols) / SYNTH_FRAMES;
+	rectangle(frame, Rect(x, frame.rows / 3, 40, frame.rows / 2),
+			  Scalar(40, 60, 160), CV_FILLED);
+	if (frame_number >= drop_frame) {
+		int bag_x = (drop_frame * frame.cols) / SYNTH_FRAMES;
+		rectangle(frame, Rect(bag_x, (frame.rows * 3) / 4, 50, 40),
+				  Scalar(20, 140, 30), CV_FILLED);
+	}
+}
+
+/**
+ opens the frames used by the Lab 4 benchmarks, which are either a recorded
+ video (or raw frame file) or, if no video is given, the synthetic scene, and
+ reads the first of them
+
+ @param video_file recorded video, or empty for the synthetic scene
+ @param cap source of the recorded frames
+ @param background output static scene of the synthetic frames
+ @param frame output first frame
+
+ @return false if the video couldn't be read
+ */
+bool openBenchmarkFrames(string video_file, FrameSource& cap, Mat& background, Mat& frame) {
+	// the scene and its noise come from opencv's global generator, so seed it
+	// to render the same sequence on every run
+	theRNG().state = SYNTH_SEED;
+	if (!video_file.empty()) {
+		cap.open(video_file);
+		if (!cap.isOpened() || !cap.read(frame)) {
+			cout << "Could not read the video " << video_file << endl;
+			return false;
+		}
+		return true;
+	}
+	// smooth the random texture so that it looks like a scene rather than
+	// noise, which the median models would never settle on
+	background.create(SYNTH_HEIGHT, SYNTH_WIDTH, CV_8UC3);
+	randu(background, Scalar::all(0), Scalar::all(256));
+	GaussianBlur(background, background, Size(15, 15), 5);
+	renderSyntheticFrame(background, 0, frame);
+	return true;
+}
+
+/**
+ reads (or renders) the next of the frames opened by openBenchmarkFrames
+
+ @param cap source of the recorded frames, or closed for the synthetic scene
+ @param background static scene of the synthetic frames
+ @param frame_number index of the frame
+ @param frame output frame
+
+ @return false at the end of the video
+ */
+bool readBenchmarkFrame(FrameSource& cap, Mat& background, int frame_number, Mat& frame) {
+	if (cap.isOpened())
+		return cap.read(frame);
+	renderSyntheticFrame(background, frame_number, frame);
+	return true;
+}
+
+/**
+ runs the abandonment detector over a video (or a raw frame file recorded
+ from one by the Lab 4 -record option), or over a synthetic scene if no
+ video is given. other background models, and gated updates, are compared
+ with the plain median model by running a median detector alongside
+ (untimed) and measuring how well the masks agree
+
+ @param video_file recorded video, or empty for the synthetic scene
+ @param frames maximum number of frames to process
+ @param model_name background model backend to measure
+ @param gate only update the changing tiles of the backgrounds
+
+ @return timings and memory, plus the mask agreement for non-median models
+ */
+BenchmarkResult benchmarkBackgroundPipeline(string video_file, int frames,
+											string model_name, bool gate) {
+	BenchmarkResult result;
+	result.name = video_file.empty() ? "lab4_background_synthetic"
+									 : "lab4_background_video";
+	// the median model keeps the original names so older baselines still apply
+	if (model_name != "median")
+		result.name += "_" + model_name;
+	if (gate)
+		result.name += "_gated";
+	result.images = 0;
+	result.seconds = 0;
+
+	FrameSource cap;
+	Mat background, frame;
+	if (!openBenchmarkFrames(video_file, cap, background, frame)) {
+		result.peak_rss = getPeakRSS();
+		return result;
+	}
+	// raw frame files are replayed without decoding, so they're reported
+	// separately from videos
+	if (cap.isZeroCopy())
+		result.name.replace(result.name.find("_video"), 6, "_raw");
+
+	Timestamper timer;
+	AbandonmentDetector detector(frame, &timer, model_name);
+	if (gate)
+		detector.EnableChangeGating();
+	Ptr<AbandonmentDetector> reference;
+	if (model_name != "median" || gate)
+		reference = Ptr<AbandonmentDetector>(new AbandonmentDetector(frame));
+	double intersection = 0, model_pixels = 0, reference_pixels = 0;
+	for (int i = 1; i < frames && readBenchmarkFrame(cap, background, i, frame); i++) {
+		// reading or rendering frames isn't part of the pipeline being timed
+		timer.ignoreTimeSinceLastRecorded();
+		int64 start = getTickCount();
+		detector.ProcessFrame(frame);
+		result.seconds += (getTickCount() - start) / getTickFrequency();
+		result.images++;
+		
+		if (reference) {
+			reference->ProcessFrame(frame);
+			Mat model_mask = detector.getMask(), reference_mask = reference->getMask();
+			Mat both;
+			bitwise_and(model_mask, reference_mask, both);
+			intersection += countNonZero(both);
+			model_pixels += countNonZero(model_mask);
+			reference_pixels += countNonZero(reference_mask);
+			timer.ignoreTimeSinceLastRecorded();
+		}
+	}
+	result.stages = getStageResults(timer);
+	result.peak_rss = getPeakRSS();
+	result.metrics["model_bytes"] = (double) detector.getModelMemoryUsage();
+	if (gate)
+		result.metrics["updated_fraction"] = detector.getUpdatedFraction();
+	// agreement of the foreground masks with the median model's, over all of
+	// the frames. both are 1 when neither model finds any foreground
+	if (reference) {
+		double union_pixels = model_pixels + reference_pixels - intersection;
+		result.metrics["mask_iou"] = (union_pixels > 0) ? intersection / union_pixels : 1.0;
+		result.metrics["mask_recall"] = (reference_pixels > 0) ? intersection / reference_pixels : 1.0;
+	}
+	return result;
+}
+
+/**
+ compares the persistent feature tracker, which keeps the previous frame's
+ pyramid and features and only re-detects features in empty cells, with the
+ per-frame Lucas-Kanade flow, which detects features and builds both pyramids
+ on every frame. both run over the same frames as the background pipeline,
+ and both draw their tracks, so the only difference is the tracking
+
+ @param video_file recorded video, or empty for the synthetic scene
+ @param frames maximum number of frames to track
+
+ @return the tracker's throughput and the latencies of its stages, the time
+		 per frame of each approach, and the speed-up of the tracker
+ */
+BenchmarkResult benchmarkFeatureTracking(string video_file, int frames) {
+	BenchmarkResult result;
+	result.name = video_file.empty() ? "lab4_tracking_synthetic"
+									 : "lab4_tracking_video";
+	result.images = 0;
+	result.seconds = 0;
+
+	FrameSource cap;
+	Mat background, frame;
+	if (!openBenchmarkFrames(video_file, cap, background, frame)) {
+		result.peak_rss = getPeakRSS();
+		return result;
+	}
+	if (cap.isZeroCopy())
+		result.name.replace(result.name.find("_video"), 6, "_raw");
+
+	FeatureTracker tracker;
+	Mat previous_gray, gray, display;
+	cvtColor(frame, previous_gray, CV_BGR2GRAY);
+	LucasKanadeOpticalFlow(tracker, previous_gray, display);
+	double per_frame_seconds = 0;
+	for (int i = 1; i < frames && readBenchmarkFrame(cap, background, i, frame); i++) {
+		cvtColor(frame, gray, CV_BGR2GRAY);
+		int64 start = getTickCount();
+		LucasKanadeOpticalFlow(previous_gray, gray, display);
+		per_frame_seconds += (getTickCount() - start) / getTickFrequency();
+		start = getTickCount();
+		LucasKanadeOpticalFlow(tracker, gray, display);
+		result.seconds += (getTickCount() - start) / getTickFrequency();
+		result.images++;
+		swap(previous_gray, gray);
+	}
+	result.stages = getStageResults(tracker.getTimer());
+	result.peak_rss = getPeakRSS();
+	if (result.images > 0) {
+		result.metrics["per_frame_flow_ms"] = per_frame_seconds * 1000.0 / result.images;
+		result.metrics["tracker_ms"] = result.seconds * 1000.0 / result.images;
+	}
+	if (result.seconds > 0)
+		result.metrics["tracker_speedup"] = per_frame_seconds / result.seconds;
+	return result;
+}
+
+/**
+ writes a result in the line based form in which a child process passes it
+ back to the parent. names are on lines of their own, as they may contain
+ spaces
+
+ @param result the result to write
+ @param out stream to write it to
+ */
+void writeResult(BenchmarkResult& result, ostream& out) {
+	out << setprecision(17);
+	out << result.name << "\n" << result.images << " " << result.seconds << " "
+		<< result.peak_rss << "\n" << result.stages.size() << "\n";
+	for (int i = 0; i < result.stages.size(); i++) {
+		StageResult& s = result.stages[i];
+		out << s.name << "\n" << s.count << " " << s.mean << " " << s.p50 << " "
+			<< s.p95 << " " << s.p99 << " " << s.max << "\n";
+	}
+	out << result.metrics.size() << "\n";
+	for (map<string, double>::iterator it = result.metrics.begin();
+		 it != result.metrics.end(); it++)
+		out << it->first << "\n" << it->second << "\n";
+}
+
+/**
+ reads a result written by writeResult
+
+ @param in stream to read from
+ @param result the result read
+ @return true if a whole result was read
+ */
+bool readResult(istream& in, BenchmarkResult& result) {
+	int number_of_stages = 0, number_of_metrics = 0;
+	if (!getline(in, result.name) ||
+		!(in >> result.images >> result.seconds >> result.peak_rss >> number_of_stages))
+		return false;
+	in.ignore(numeric_limits<streamsize>::max(), '\n');
+	for (int i = 0; i < number_of_stages; i++) {
+		StageResult s;
+		if (!getline(in, s.name) ||
+			!(in >> s.count >> s.mean >> s.p50 >> s.p95 >> s.p99 >> s.max))
+			return false;
+		in.ignore(numeric_limits<streamsize>::max(), '\n');
+		result.stages.push_back(s);
+	}
+	if (!(in >> number_of_metrics))
+		return false;
+	in.ignore(numeric_limits<streamsize>::max(), '\n');
+	for (int i = 0; i < number_of_metrics; i++) {
+		string metric;
+		double value;
+		if (!getline(in, metric) || !(in >> value))
+			return false;
+		in.ignore(numeric_limits<streamsize>::max(), '\n');
+		result.metrics[metric] = value;
+	}
+	return true;
+}
+
+/**
+ runs a benchmark in a forked child process and passes its result back over a
+ pipe. the peak resident set size is a process-wide high-water mark, so this
+ is what lets it be put down to the one benchmark. the child starts with
+ whatever the parent has resident, but the parent only parses the arguments
+ and collects results, so that is the same small amount for every benchmark
+
+ @param benchmark runs the benchmark
+ @param result the benchmark's result
+ @return false if the benchmark failed, in which case there is no result
+ */
+bool runInChild(function<BenchmarkResult()> benchmark, BenchmarkResult& result) {
+	// anything still buffered would otherwise be written by both processes
+	cout.flush();
+	fflush(stdout);
+	int channel[2];
+	pid_t child = -1;
+	if (pipe(channel) == 0) {
+		child = fork();
+		if (child < 0) {
+			close(channel[0]);
+			close(channel[1]);
+		}
+	}
+	if (child < 0) {
+		cout << "Could not start a process for the benchmark, so its peak RSS "
+			 << "includes the benchmarks before it" << endl;
+		result = benchmark();
+		return true;
+	}
+	if (child == 0) {
+		close(channel[0]);
+		ostringstream out;
+		BenchmarkResult child_result = benchmark();
+		writeResult(child_result, out);
+		string text = out.str();
+		size_t written = 0;
+		while (written < text.size()) {
+			ssize_t count = write(channel[1], text.data() + written, text.size() - written);
+			if (count <= 0)
+				break;
+			written += count;
+		}
+		close(channel[1]);
+		cout.flush();
+		fflush(stdout);
+		_exit((written == text.size()) ? 0 : 1);
+	}
+
+	close(channel[1]);
+	string text;
+	char buffer[4096];
+	ssize_t count;
+	while ((count = read(channel[0], buffer, sizeof(buffer))) > 0)
+		text.append(buffer, count);
+	close(channel[0]);
+	int status = 0;
+	waitpid(child, &status, 0);
+	istringstream in(text);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !readResult(in, result)) {
+		cout << "A benchmark failed in its child process" << endl;
+		return false;
+	}
+	return true;
+}
+
+// write every result as one JSON document
+void writeResultsJSON(vector<BenchmarkResult>& results, ostream& out) {
+	out << "{\"benchmarks\": [";
+	for (int i = 0; i < results.size(); i++) {
+		BenchmarkResult& r = results[i];
+		out << (i > 0 ? ",\n  " : "\n  ")
+			<< "{\"name\": \"" << r.name << "\", \"images\": " << r.images
+			<< fixed << setprecision(3)
+			<< ", \"seconds\": " << r.seconds
+			<< ", \"images_per_second\": " << r.imagesPerSecond()
+			<< ", \"peak_rss_bytes\": " << r.peak_rss;
+		for (map<string, double>::iterator it = r.metrics.begin();
+			 it != r.metrics.end(); it++)
+			out << ", \"" << it->first << "\": " << it->second;
+		out << ", \"stages\": [";
+		for (int j = 0; j < r.stages.size(); j++) {
+			StageResult& s = r.stages[j];
+			out << (j > 0 ? ",\n    " : "\n    ")
+				<< "{\"name\": \"" << EscapeJSON(s.name) << "\""
+				<< ", \"count\": " << s.count
+				<< ", \"mean_us\": " << setprecision(1) << s.mean
+				<< ", \"p50_us\": " << s.p50 << ", \"p95_us\": " << s.p95
+				<< ", \"p99_us\": " << s.p99 << ", \"max_us\": " << s.max << "}";
+		}
+		out << "]}";
+	}
+	out << "\n]}" << endl;
+}
+
+// write every result as flat 'benchmark,metric,value' rows. this is also the
+// format of a stored baseline, so any earlier run's csv can be used as one
+void writeResultsCSV(vector<BenchmarkResult>& results, ostream& out) {
+	out << "benchmark,metric,value" << endl;
+	out << fixed << setprecision(3);
+	for (int i = 0; i < results.size(); i++) {
+		BenchmarkResult& r = results[i];
+		out << r.name << ",images_per_second," << r.imagesPerSecond() << endl;
+		out << r.name << ",peak_rss_bytes," << r.peak_rss << endl;
+		for (map<string, double>::iterator it = r.metrics.begin();
+			 it != r.metrics.end(); it++)
+			out << r.name << "," << it->first << "," << it->second << endl;
+		for (int j = 0; j < r.stages.size(); j++) {
+			StageResult& s = r.stages[j];
+			out << r.name << "," << s.name << ".p50_us," << s.p50 << endl;
+			out << r.name << "," << s.name << ".p95_us," << s.p95 << endl;
+			out << r.name << "," << s.name << ".p99_us," << s.p99 << endl;
+		}
+	}
+}
+
+/**
+ compares this run against a stored baseline csv. throughput is expected not
+ to drop, and latencies and memory are expected not to rise, by more than the
+ tolerance
+
+ @param baseline_file csv written by an earlier run
+ @param results_file csv written by this run
+ @param tolerance allowed change in percent
+
+ @return the number of metrics that regressed, or -1 if a file is unreadable
+ */
+int compareWithBaseline(string baseline_file, string results_file,
+						double tolerance) {
+	map<string, double> baseline, current;
+	string files[2] = { baseline_file, results_file };
+	map<string, double>* values[2] = { &baseline, &current };
+	for (int f = 0; f < 2; f++) {
+		ifstream in(files[f].c_str());
+		if (!in.is_open()) {
+			cout << "Could not open " << files[f] << endl;
+			return -1;
+		}
+		string line;
+		getline(in, line);
+		while (getline(in, line)) {
+			size_t split = line.rfind(',');
+			if (split != string::npos)
+				(*values[f])[line.substr(0, split)] = atof(line.substr(split+1).c_str());
+		}
+	}
+
+	int regressions = 0;
+	cout << "Comparison with " << baseline_file << " (tolerance "
+		 << tolerance << "%):" << endl;
+	for (map<string, double>::iterator it = current.begin();
+		 it != current.end(); it++) {
+		if (baseline.count(it->first) == 0 || baseline[it->first] == 0)
+			continue;
+		double change = (it->second - baseline[it->first]) * 100 / baseline[it->first];
+		bool higher_is_better = it->first.find("images_per_second") != string::npos ||
+								it->first.find("mask_") != string::npos ||
+								it->first.find("agreement") != string::npos ||
+								it->first.find("hit_rate") != string::npos ||
+								it->first.find("speedup") != string::npos;
+		bool regressed = higher_is_better ? (change < -tolerance)
+										  : (change > tolerance);
+		if (regressed)
+			regressions++;
+		cout << (regressed ? "  REGRESSION " : "  ") << it->first << ": "
+			 << baseline[it->first] << " -> " << it->second << " ("
+			 << showpos << setprecision(1) << change << noshowpos << "%)" << endl;
+	}
+	return regressions;
+}
+
+int main(int argc, char* argv[]) {
+	string root = ".", output = "benchmark_results", baseline, video_file;
+	string model_name = "median";
+	bool gate = false;
+	int repeat = 1, frames = SYNTH_FRAMES, catalogue = 0;
+	double tolerance = DEFAULT_TOLERANCE;
+
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "-o" && has_value) {
+			output = argv[++i];
+		} else if (arg == "-baseline" && has_value) {
+			baseline = argv[++i];
+		} else if (arg == "-tolerance" && has_value) {
+			tolerance = atof(argv[++i]);
+		} else if (arg == "-repeat" && has_value) {
+			repeat = atoi(argv[++i]);
+		} else if (arg == "-frames" && has_value) {
+			frames = atoi(argv[++i]);
+		} else if (arg == "-video" && has_value) {
+			video_file = argv[++i];
+		} else if (arg == "-model" && has_value) {
+			model_name = argv[++i];
+		} else if (arg == "-catalogue" && has_value) {
+			catalogue = atoi(argv[++i]);
+		} else if (arg == "-gate") {
+			gate = true;
+		} else if (arg[0] != '-') {
+			root = arg;
+		} else {
+			cout << "Usage: " << argv[0] << " [repository root]"
+				<< " [-o output prefix] [-baseline baseline.csv]"
+				<< " [-tolerance percent] [-repeat n] [-frames n]"
+				<< " [-video recorded.avi|recorded.raw] [-model median|frugal|average|all]"
+				<< " [-gate] [-catalogue distractor pages]" << endl;
+			return 0;
+		}
+	}
+
+	// each benchmark runs in a process of its own, so that its peak RSS
+	// doesn't depend on which benchmarks ran before it
+	vector<BenchmarkResult> results;
+	vector<function<BenchmarkResult()> > benchmarks;
+	benchmarks.push_back([&] { return benchmarkGlueInspection(root+"/CV Lab 2/images", repeat); });
+	benchmarks.push_back([&] { return benchmarkResultCache(root+"/CV Lab 2/images", repeat); });
+	benchmarks.push_back([&] { return benchmarkGlueStrips(root+"/CV Lab 2/images", repeat, output+"_strip.ppm"); });
+	benchmarks.push_back([&] { return benchmarkPageRecognition(root+"/CV Lab 3/images", repeat); });
+	benchmarks.push_back([&] { return benchmarkPageIndex(root+"/CV Lab 3/images", repeat, catalogue); });
+	benchmarks.push_back([&] { return benchmarkPageStream(root+"/CV Lab 3/images", repeat); });
+	string models[3] = { "median", "frugal", "average" };
+	if (model_name == "all") {
+		for (int i = 0; i < 3; i++)
+			benchmarks.push_back([&, i] { return benchmarkBackgroundPipeline(video_file, frames, models[i], gate); });
+	} else {
+		benchmarks.push_back([&] { return benchmarkBackgroundPipeline(video_file, frames, model_name, gate); });
+	}
+	benchmarks.push_back([&] { return benchmarkFeatureTracking(video_file, frames); });
+	for (int i = 0; i < benchmarks.size(); i++) {
+		BenchmarkResult result;
+		if (runInChild(benchmarks[i], result))
+			results.push_back(result);
+	}
+
+	for (int i = 0; i < results.size(); i++) {
+		cout << results[i].name << ": " << results[i].images << " images, "
+			 << fixed << setprecision(2) << results[i].imagesPerSecond()
+			 << " images/s, peak RSS " << results[i].peak_rss / (1024 * 1024)
+			 << "MB" << endl;
+		for (int j = 0; j < results[i].stages.size(); j++) {
+			StageResult& s = results[i].stages[j];
+			cout << "  " << s.name << ": p50 " << s.p50 << "us, p95 " << s.p95
+				 << "us, p99 " << s.p99 << "us, max " << s.max << "us" << endl;
+		}
+		for (map<string, double>::iterator it = results[i].metrics.begin();
+			 it != results[i].metrics.end(); it++)
+			cout << "  " << it->first << ": " << setprecision(3) << it->second << endl;
+	}
+
+	ofstream json((output+".json").c_str());
+	writeResultsJSON(results, json);
+	ofstream csv((output+".csv").c_str());
+	writeResultsCSV(results, csv);
+	csv.close();
+
+	if (!baseline.empty()) {
+		int regressions = compareWithBaseline(baseline, output+".csv", tolerance);
+		return (regressions == 0) ? 0 : 1;
+	}
+	return 0;
+}
@@ -0,0 +1,307 @@
+#include <iostream>
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "ResultCache.h"
+
+using namespace std;
+using namespace cv;
+
+// A 64 bit hash of a block of memory (this is xxHash64, which is fast enough
+// to hash a file or frame in a small fraction of the time taken to decode it)
+#define HASH_PRIME_1 11400714785074694791ULL
+#define HASH_PRIME_2 14029467366897019727ULL
+#define HASH_PRIME_3 1609587929392839161ULL
+#define HASH_PRIME_4 9650029242287828579ULL
+#define HASH_PRIME_5 2870177450012600261ULL
+// HashFile reads files in chunks of this many bytes, a multiple of 32
+#define HASH_FILE_CHUNK (1 << 20)
+
+static inline uint64 HashRotateLeft( uint64 value, int bits )
+{
+	return (value << bits) | (value >> (64-bits));
+}
+
+static inline uint64 HashRead64( const unsigned char* data )
+{
+	uint64 value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static inline uint64 HashRound( uint64 accumulator, uint64 input )
+{
+	accumulator += input*HASH_PRIME_2;
+	return HashRotateLeft(accumulator, 31)*HASH_PRIME_1;
+}
+
+static inline uint64 HashMerge( uint64 hash, uint64 accumulator )
+{
+	hash ^= HashRound(0, accumulator);
+	return hash*HASH_PRIME_1 + HASH_PRIME_4;
+}
+
+// The four lanes start from the seed and take 32 bytes at a time, 8 each
+static inline void HashStartLanes( uint64 lanes[4], uint64 seed )
+{
+	lanes[0] = seed + HASH_PRIME_1 + HASH_PRIME_2;
+	lanes[1] = seed + HASH_PRIME_2;
+	lanes[2] = seed;
+	lanes[3] = seed - HASH_PRIME_1;
+}
+
+// Feeds whole 32 byte stripes to the lanes, returning the end of the last one
+static const unsigned char* HashStripes( uint64 lanes[4], const unsigned char* position, const unsigned char* end )
+{
+	for (; position+32 <= end; position += 32)
+	{
+		lanes[0] = HashRound(lanes[0], HashRead64(position));
+		lanes[1] = HashRound(lanes[1], HashRead64(position+8));
+		lanes[2] = HashRound(lanes[2], HashRead64(position+16));
+		lanes[3] = HashRound(lanes[3], HashRead64(position+24));
+	}
+	return position;
+}
+
+static uint64 HashMergeLanes( uint64 lanes[4] )
+{
+	uint64 hash = HashRotateLeft(lanes[0], 1) + HashRotateLeft(lanes[1], 7) + HashRotateLeft(lanes[2], 12) + HashRotateLeft(lanes[3], 18);
+	for (int lane=0; lane < 4; lane++)
+		hash = HashMerge(hash, lanes[lane]);
+	return hash;
+}
+
+// Mixes in the total length and the last (less than 32) bytes
+static uint64 HashFinish( uint64 hash, uint64 length, const unsigned char* position, const unsigned char* end )
+{
+	hash += length;
+	for (; position+8 <= end; position += 8)
+	{
+		hash ^= HashRound(0, HashRead64(position));
+		hash = HashRotateLeft(hash, 27)*HASH_PRIME_1 + HASH_PRIME_4;
+	}
+	if (position+4 <= end)
+	{
+		unsigned int word;
+		memcpy(&word, position, sizeof(word));
+		hash ^= (uint64) word*HASH_PRIME_1;
+		hash = HashRotateLeft(hash, 23)*HASH_PRIME_2 + HASH_PRIME_3;
+		position += 4;
+	}
+	for (; position < end; position++)
+	{
+		hash ^= (*position)*HASH_PRIME_5;
+		hash = HashRotateLeft(hash, 11)*HASH_PRIME_1;
+	}
+	hash ^= hash >> 33;
+	hash *= HASH_PRIME_2;
+	hash ^= hash >> 29;
+	hash *= HASH_PRIME_3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+uint64 HashBytes( const void* data, size_t length, uint64 seed )
+{
+	const unsigned char* position = (const unsigned char*) data;
+	const unsigned char* end = position+length;
+	uint64 hash = seed + HASH_PRIME_5;
+	if (length >= 32)
+	{
+		uint64 lanes[4];
+		HashStartLanes(lanes, seed);
+		position = HashStripes(lanes, position, end);
+		hash = HashMergeLanes(lanes);
+	}
+	return HashFinish(hash, length, position, end);
+}
+
+// The hash of an image covers its size and type as well as its pixels, so
+// that images with the same bytes in a different shape differ
+uint64 HashImage( Mat& image, uint64 seed )
+{
+	int shape[3] = { image.rows, image.cols, image.type() };
+	uint64 hash = HashBytes(shape, sizeof(shape), seed);
+	if (image.isContinuous())
+		return HashBytes(image.data, image.total()*image.elemSize(), hash);
+	for (int row=0; row < image.rows; row++)
+		hash = HashBytes(image.ptr(row), image.cols*image.elemSize(), hash);
+	return hash;
+}
+
+// Hashes the bytes of a file without decoding it.  The file is read a chunk
+// at a time, so the memory needed doesn't grow with its size, and the chunks
+// are whole stripes so the hash is the same as HashBytes over the whole file.
+bool HashFile( String filename, uint64& hash, uint64 seed )
+{
+	ifstream file(filename.c_str(), ios::binary);
+	if (!file.is_open())
+		return false;
+	vector<unsigned char> chunk(HASH_FILE_CHUNK);
+	uint64 lanes[4];
+	HashStartLanes(lanes, seed);
+	uint64 length = 0;
+	while (true)
+	{
+		file.read((char*) &chunk[0], chunk.size());
+		size_t bytes = (size_t) file.gcount();
+		const unsigned char* start = &chunk[0];
+		const unsigned char* end = start+bytes;
+		const unsigned char* position = HashStripes(lanes, start, end);
+		length += bytes;
+		if (file)
+			continue;
+		if (file.bad())
+			return false;
+		hash = HashFinish((length >= 32) ? HashMergeLanes(lanes) : seed + HASH_PRIME_5, length, position, end);
+		return true;
+	}
+}
+
+// The entry files start with this header, followed by the values as doubles
+struct ResultCacheHeader {
+	unsigned int mMagic;
+	unsigned int mVersion;
+	uint64 mFingerprint;
+	uint64 mKey;
+	unsigned int mNumberOfValues;
+	unsigned int mReserved;
+};
+
+// The version should name the processing and include any parameters which
+// change its results
+ResultCache::ResultCache( String version, String directory, int maximum_entries )
+{
+	mFingerprint = HashBytes(version.c_str(), version.size(), RESULT_CACHE_VERSION);
+	mDirectory = directory;
+	mMaximumEntries = std::max(1, maximum_entries);
+	mMemoryHits = 0;
+	mDiskHits = 0;
+	mMisses = 0;
+	mStores = 0;
+	if (!mDirectory.empty())
+		mkdir(mDirectory.c_str(), 0755);
+}
+
+uint64 ResultCache::getKey( uint64 content_hash )
+{
+	return HashBytes(&content_hash, sizeof(content_hash), mFingerprint);
+}
+
+String ResultCache::getEntryFilename( uint64 key )
+{
+	char name[32];
+	sprintf(name, "%016llx.res", (unsigned long long) key);
+	return mDirectory + "/" + name;
+}
+
+// Makes an entry the most recently used, evicting the least recently used
+// entries beyond the maximum.  The lock must be held.
+void ResultCache::Remember( uint64 key, vector<double>& values )
+{
+	map<uint64, EntryList::iterator>::iterator existing = mEntryIndex.find(key);
+	if (existing != mEntryIndex.end())
+		mEntries.erase(existing->second);
+	mEntries.push_front(make_pair(key, values));
+	mEntryIndex[key] = mEntries.begin();
+	while ((int) mEntries.size() > mMaximumEntries)
+	{
+		mEntryIndex.erase(mEntries.back().first);
+		mEntries.pop_back();
+	}
+}
+
+bool ResultCache::Lookup( uint64 content_hash, vector<double>& values )
+{
+	uint64 key = getKey(content_hash);
+	std::lock_guard<std::mutex> lock(mLock);
+	map<uint64, EntryList::iterator>::iterator entry = mEntryIndex.find(key);
+	if (entry != mEntryIndex.end())
+	{
+		// move it to the front of the list
+		mEntries.splice(mEntries.begin(), mEntries, entry->second);
+		values = mEntries.front().second;
+		mMemoryHits++;
+		return true;
+	}
+	if (!mDirectory.empty())
+	{
+		ifstream file(getEntryFilename(key).c_str(), ios::binary);
+		ResultCacheHeader header;
+		if (file.read((char*) &header, sizeof(header)) && (header.mMagic == RESULT_CACHE_MAGIC) &&
+			(header.mVersion == RESULT_CACHE_VERSION) && (header.mFingerprint == mFingerprint) && (header.mKey == key))
+		{
+			vector<double> stored(header.mNumberOfValues);
+			if (stored.empty() || file.read((char*) &stored[0], stored.size()*sizeof(double)))
+			{
+				Remember(key, stored);
+				values = stored;
+				mDiskHits++;
+				return true;
+			}
+		}
+	}
+	mMisses++;
+	return false;
+}
+
+// Entries are written to a temporary file which is then renamed, so that an
+// interrupted write never leaves a partial entry
+void ResultCache::Store( uint64 content_hash, vector<double>& values )
+{
+	uint64 key = getKey(content_hash);
+	std::lock_guard<std::mutex> lock(mLock);
+	Remember(key, values);
+	mStores++;
+	if (mDirectory.empty())
+		return;
+	String filename = getEntryFilename(key);
+	String temporary_filename = filename + ".tmp";
+	ResultCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.mMagic = RESULT_CACHE_MAGIC;
+	header.mVersion = RESULT_CACHE_VERSION;
+	header.mFingerprint = mFingerprint;
+	header.mKey = key;
+	header.mNumberOfValues = (unsigned int) values.size();
+	{
+		ofstream file(temporary_filename.c_str(), ios::binary);
+		file.write((const char*) &header, sizeof(header));
+		if (!values.empty())
+			file.write((const char*) &values[0], values.size()*sizeof(double));
+		if (!file)
+		{
+			cout << "Could not write the cache entry: " << temporary_filename << endl;
+			return;
+		}
+	}
+	if (rename(temporary_filename.c_str(), filename.c_str()) != 0)
+		cout << "Could not write the cache entry: " << filename << endl;
+}
+
+uint64 ResultCache::getFingerprint()
+{
+	return mFingerprint;
+}
+
+int ResultCache::getHits()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	return mMemoryHits+mDiskHits;
+}
+
+int ResultCache::getMisses()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	return mMisses;
+}
+
+String ResultCache::getString()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	std::ostringstream temp;
+	temp << "Result cache: " << mMemoryHits << " memory hits, " << mDiskHits << " disk hits, " << mMisses << " misses, "
+		 << mStores << " stored, " << mEntries.size() << "/" << mMaximumEntries << " in memory";
+	return temp.str();
+}
@@ -0,0 +1,46 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <list>
+#include "Utilities.h"
+
+uint64 HashBytes( const void* data, size_t length, uint64 seed=0 );
+uint64 HashImage( Mat& image, uint64 seed=0 );
+bool HashFile( String filename, uint64& hash, uint64 seed=0 );
+
+// Remembers the results of processing some content (such as an image file or a
+// frame) so that byte-identical content is answered without being processed
+// again.  Entries are keyed by a hash of the content combined with a
+// fingerprint of the version and parameters of the processing, so changing
+// either invalidates them.  The most recently used entries are kept in memory,
+// and if a directory is given every entry is also kept there, one file each,
+// so that the cache persists between runs.
+#define RESULT_CACHE_MAGIC 0x43534552
+#define RESULT_CACHE_VERSION 1
+class ResultCache {
+private:
+	typedef list<pair<uint64, vector<double> > > EntryList;
+	String mDirectory;
+	uint64 mFingerprint;
+	int mMaximumEntries;
+	EntryList mEntries;
+	map<uint64, EntryList::iterator> mEntryIndex;
+	int mMemoryHits;
+	int mDiskHits;
+	int mMisses;
+	int mStores;
+	std::mutex mLock;
+	uint64 getKey( uint64 content_hash );
+	String getEntryFilename( uint64 key );
+	void Remember( uint64 key, vector<double>& values );
+public:
+	ResultCache( String version, String directory="", int maximum_entries=1024 );
+	bool Lookup( uint64 content_hash, vector<double>& values );
+	void Store( uint64 content_hash, vector<double>& values );
+	uint64 getFingerprint();
+	int getHits();
+	int getMisses();
+	String getString();
+};
+
+#endif
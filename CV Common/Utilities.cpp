@@ -0,0 +1,913 @@
+/*
+ * This code is provided as part of "A Practical Introduction to Computer Vision with OpenCV"
+ * by Kenneth Dawson-Howe  Wiley & Sons Inc. 2014.  All rights reserved.
+ */
+#include "opencv2/core.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/video.hpp"
+#include "opencv2/highgui.hpp"
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string.h>
+#include <float.h>
+#if CV_SSE2
+#include <emmintrin.h>
+#endif
+#include "Utilities.h"
+
+using namespace std;
+using namespace cv;
+
+void writeText( Mat image, char* text, int row, int column, Scalar passed_colour, double scale, int thickness )
+{
+	Scalar colour( 0, 0, 255);
+	Point location( column, row );
+	putText( image, text, location, FONT_HERSHEY_SIMPLEX, scale, (passed_colour.val[0] == -1.0) ? colour : passed_colour, thickness );
+}
+
+Mat JoinImagesHorizontally( Mat& image1, char* name1, Mat& image2, char* name2, int spacing, Scalar passed_colour/*=-1.0*/ )
+{
+	Mat result( (image1.rows > image2.rows) ? image1.rows : image2.rows,
+		        image1.cols + image2.cols + spacing,
+				image1.type() );
+	result.setTo(Scalar(255,255,255));
+    Mat imageROI;
+	imageROI = result(cv::Rect(0,0,image1.cols,image1.rows));
+	image1.copyTo(imageROI);
+	if (spacing > 0)
+	{
+		imageROI = result(cv::Rect(image1.cols,0,spacing,image1.rows));
+		imageROI.setTo(Scalar(255,255,255));
+	}
+	imageROI = result(cv::Rect(image1.cols+spacing,0,image2.cols,image2.rows));
+	image2.copyTo(imageROI);
+	writeText( result, name1, 13, 6, passed_colour );
+	writeText( imageROI, name2, 13, 6, passed_colour );
+	return result;
+}
+
+Mat JoinImagesVertically( Mat& image1, char* name1, Mat& image2, char* name2, int spacing, Scalar passed_colour/*=-1.0*/ )
+{
+	Mat result( image1.rows + image2.rows + spacing,
+		        (image1.cols > image2.cols) ? image1.cols : image2.cols,
+				image1.type() );
+	result.setTo(Scalar(255,255,255));
+	Mat imageROI;
+	imageROI = result(cv::Rect(0,0,image1.cols,image1.rows));
+	image1.copyTo(imageROI);
+	if (spacing > 0)
+	{
+		imageROI = result(cv::Rect(0,image1.rows,image1.cols,spacing));
+		imageROI.setTo(Scalar(255,255,255));
+	}
+	imageROI = result(cv::Rect(0,image1.rows+spacing,image2.cols,image2.rows));
+	image2.copyTo(imageROI);
+	writeText( result, name1, 13, 6, passed_colour );
+	writeText( imageROI, name2, 13, 6, passed_colour );
+	return result;
+}
+
+void addGaussianNoise(Mat &image, double average, double standard_deviation)
+{
+	// We need to work with signed images (as noise can be negative as well as positive).
+	// We chose 16 bit signed images as if we converted an 8 bits unsigned image to a
+	// signed version we would lose precision.
+	int image_type = (image.channels() == 3) ? CV_16SC3 : CV_16SC1;
+	Mat noise_image(image.size(), image_type);
+    randn(noise_image, Scalar::all(average), Scalar::all(standard_deviation));
+	Mat temp_image;
+	image.convertTo(temp_image,image_type);
+	addWeighted(temp_image,1.0,noise_image,1.0,0.0,temp_image);
+	temp_image.convertTo(image,image.type());
+}
+
+VideoWriter* OpenVideoFile( char* filename, VideoCapture& video_to_emulate, int horizontal_multiple, int vertical_multiple, int spacing )
+{
+	int codec = static_cast<int>(video_to_emulate.get(CV_CAP_PROP_FOURCC));
+	Size image_size = Size((int) video_to_emulate.get(CV_CAP_PROP_FRAME_WIDTH),
+                           (int) video_to_emulate.get(CV_CAP_PROP_FRAME_HEIGHT));
+	double fps = video_to_emulate.get(CV_CAP_PROP_FPS);
+	return OpenVideoFile( filename, codec, image_size, fps, horizontal_multiple, vertical_multiple, spacing );
+}
+
+VideoWriter* OpenVideoFile( char* filename, int codec, Size image_size, double fps, int horizontal_multiple, int vertical_multiple, int spacing )
+{
+	VideoWriter* output_video = new VideoWriter();                                     
+	Size video_size = Size((int) image_size.width*horizontal_multiple + spacing*(horizontal_multiple-1),
+		                   (int) image_size.height*vertical_multiple + spacing*(vertical_multiple-1));
+    output_video->open(filename, codec, fps, video_size, true);
+    if (!output_video->isOpened())
+    {
+        cout  << "Could not open the output video for write: " << filename << endl;
+    }
+	return output_video;
+}
+
+void WriteVideoFrame( VideoWriter* output_video, Mat& video_frame )
+{
+    *output_video << video_frame;
+}
+
+void CloseVideoFile( VideoWriter* video )
+{
+	delete video;
+}
+
+// Reads the image size from the frame header of a JPEG file without decoding
+// it.  Returns false if the file is not a JPEG or has no frame header.
+bool ReadJPEGSize( String filename, Size& image_size )
+{
+	ifstream file(filename.c_str(), ios::binary);
+	unsigned char marker[4];
+	if (!file.read((char*) marker, 2) || (marker[0] != 0xFF) || (marker[1] != 0xD8))
+		return false;
+	for (;;)
+	{
+		// markers may be preceded by any number of 0xFF fill bytes
+		int marker_type = 0xFF;
+		while (marker_type == 0xFF)
+		{
+			marker_type = file.get();
+			if (marker_type == EOF)
+				return false;
+		}
+		if ((marker_type == 0xD8) || ((marker_type >= 0xD0) && (marker_type <= 0xD7)) || (marker_type == 0x01))
+			continue;   // markers without a segment
+		if ((marker_type == 0xD9) || (marker_type == 0xDA))
+			return false;   // end of image or start of scan before any frame header
+		if (!file.read((char*) marker, 2))
+			return false;
+		int segment_length = (marker[0] << 8) | marker[1];
+		// SOF0 to SOF15, other than DHT (C4), JPG (C8) and DAC (CC)
+		if ((marker_type >= 0xC0) && (marker_type <= 0xCF) &&
+			(marker_type != 0xC4) && (marker_type != 0xC8) && (marker_type != 0xCC))
+		{
+			unsigned char frame_header[5];
+			if (!file.read((char*) frame_header, 5))
+				return false;
+			image_size = Size((frame_header[3] << 8) | frame_header[4], (frame_header[1] << 8) | frame_header[2]);
+			return (image_size.width > 0) && (image_size.height > 0);
+		}
+		if (segment_length < 2)
+			return false;
+		file.seekg(segment_length-2, ios::cur);
+	}
+}
+
+// Chooses the imread flags which decode an image of image_size at the smallest
+// JPEG scale (1/2, 1/4 or 1/8, applied by the decoder in the DCT domain) which
+// is still at least minimum_size.  The decoder rounds the reduced size up.
+int ChooseReducedReadFlags( Size image_size, Size minimum_size, int flags )
+{
+	if ((flags != IMREAD_COLOR) && (flags != IMREAD_GRAYSCALE))
+		return flags;
+	int reduced_colour_flags[3] = { IMREAD_REDUCED_COLOR_8, IMREAD_REDUCED_COLOR_4, IMREAD_REDUCED_COLOR_2 };
+	int reduced_grey_flags[3] = { IMREAD_REDUCED_GRAYSCALE_8, IMREAD_REDUCED_GRAYSCALE_4, IMREAD_REDUCED_GRAYSCALE_2 };
+	for (int scale=0, denominator=8; (scale < 3); scale++, denominator /= 2)
+	{
+		if (((image_size.width+denominator-1)/denominator >= minimum_size.width) &&
+			((image_size.height+denominator-1)/denominator >= minimum_size.height))
+			return (flags == IMREAD_COLOR) ? reduced_colour_flags[scale] : reduced_grey_flags[scale];
+	}
+	return flags;
+}
+
+// Reads an image at no less than minimum_size, letting the JPEG decoder
+// downscale it where possible.  Other formats are read at full size.
+Mat ReadImageAtScale( String filename, Size minimum_size, int flags )
+{
+	Size image_size;
+	if (ReadJPEGSize( filename, image_size ))
+		flags = ChooseReducedReadFlags( image_size, minimum_size, flags );
+	return imread( filename, flags );
+}
+
+
+
+LatencyHistogram::LatencyHistogram()
+{
+	mCounts.resize((LATENCY_MAGNITUDES+1)*LATENCY_SUB_BUCKETS);
+	Reset();
+}
+void LatencyHistogram::Reset()
+{
+	std::fill(mCounts.begin(), mCounts.end(), 0);
+	mTotalCount = 0;
+	mMinimumValue = 0;
+	mMaximumValue = 0;
+	mSum = 0.0;
+}
+int LatencyHistogram::getBucketIndex(int64 value)
+{
+	// Values below LATENCY_SUB_BUCKETS are stored exactly.  Larger values keep
+	// their top LATENCY_SUB_BUCKET_BITS+1 bits, indexed by how far they were shifted.
+	if (value < LATENCY_SUB_BUCKETS)
+		return (int) value;
+	int shift = 0;
+	while ((value >> shift) >= 2*LATENCY_SUB_BUCKETS)
+		shift++;
+	int index = shift*LATENCY_SUB_BUCKETS + (int) (value >> shift);
+	return (index < (int) mCounts.size()) ? index : (int) mCounts.size()-1;
+}
+int64 LatencyHistogram::getHighestValueInBucket(int index)
+{
+	if (index < 2*LATENCY_SUB_BUCKETS)
+		return index;
+	int shift = index/LATENCY_SUB_BUCKETS - 1;
+	int64 sub_bucket = index - shift*LATENCY_SUB_BUCKETS;
+	return ((sub_bucket+1) << shift) - 1;
+}
+void LatencyHistogram::RecordValue(int64 value)
+{
+	if (value < 0)
+		value = 0;
+	mCounts[getBucketIndex(value)]++;
+	if ((mTotalCount == 0) || (value < mMinimumValue))
+		mMinimumValue = value;
+	if (value > mMaximumValue)
+		mMaximumValue = value;
+	mSum += (double) value;
+	mTotalCount++;
+}
+int64 LatencyHistogram::getCount()
+{
+	return mTotalCount;
+}
+int64 LatencyHistogram::getMinimum()
+{
+	return mMinimumValue;
+}
+int64 LatencyHistogram::getMaximum()
+{
+	return mMaximumValue;
+}
+double LatencyHistogram::getMean()
+{
+	return (mTotalCount > 0) ? mSum/((double) mTotalCount) : 0.0;
+}
+int64 LatencyHistogram::getValueAtPercentile(double percentile)
+{
+	if (mTotalCount == 0)
+		return 0;
+	int64 target_count = (int64) ceil((percentile/100.0)*((double) mTotalCount));
+	if (target_count < 1)
+		target_count = 1;
+	int64 cumulative_count = 0;
+	for (int index=0; index < (int) mCounts.size(); index++)
+	{
+		cumulative_count += mCounts[index];
+		if (cumulative_count >= target_count)
+			return std::min(getHighestValueInBucket(index), mMaximumValue);
+	}
+	return mMaximumValue;
+}
+
+
+String EscapeJSON( String text )
+{
+	String escaped_text;
+	for (size_t character=0; character < text.size(); character++)
+	{
+		if ((text[character] == '"') || (text[character] == '\\'))
+			escaped_text += '\\';
+		escaped_text += text[character];
+	}
+	return escaped_text;
+}
+
+
+std::mutex Tracer::mRegistryLock;
+vector<TraceBuffer*> Tracer::mBuffers;
+vector<String> Tracer::mNames;
+map<String,int> Tracer::mNameIds;
+pthread_key_t Tracer::mThreadBufferKey;
+pthread_once_t Tracer::mThreadBufferKeyOnce = PTHREAD_ONCE_INIT;
+
+void Tracer::CreateThreadBufferKey()
+{
+	// No destructor: buffers outlive their threads so they can still be exported
+	pthread_key_create(&mThreadBufferKey, NULL);
+}
+TraceBuffer* Tracer::getThreadBuffer()
+{
+	pthread_once(&mThreadBufferKeyOnce, CreateThreadBufferKey);
+	TraceBuffer* buffer = (TraceBuffer*) pthread_getspecific(mThreadBufferKey);
+	if (buffer == NULL)
+	{
+		buffer = new TraceBuffer();
+		buffer->mDroppedEvents = 0;
+		std::lock_guard<std::mutex> lock(mRegistryLock);
+		buffer->mThreadNumber = (int) mBuffers.size();
+		mBuffers.push_back(buffer);
+		pthread_setspecific(mThreadBufferKey, buffer);
+	}
+	return buffer;
+}
+int Tracer::RegisterName(String name)
+{
+	std::lock_guard<std::mutex> lock(mRegistryLock);
+	map<String,int>::iterator existing = mNameIds.find(name);
+	if (existing != mNameIds.end())
+		return existing->second;
+	int name_id = (int) mNames.size();
+	mNames.push_back(name);
+	mNameIds[name] = name_id;
+	return name_id;
+}
+void Tracer::Record(int name_id, int64 start_ticks, int64 end_ticks)
+{
+	TraceBuffer* buffer = getThreadBuffer();
+	// Only contended while the trace is being exported or cleared
+	std::lock_guard<std::mutex> lock(buffer->mLock);
+	if ((int) buffer->mEvents.size() >= TRACE_BUFFER_CAPACITY)
+	{
+		buffer->mDroppedEvents++;
+		return;
+	}
+	TraceEvent event = { name_id, start_ticks, end_ticks };
+	buffer->mEvents.push_back(event);
+}
+void Tracer::Clear()
+{
+	std::lock_guard<std::mutex> lock(mRegistryLock);
+	for (int buffer=0; buffer < (int) mBuffers.size(); buffer++)
+	{
+		std::lock_guard<std::mutex> buffer_lock(mBuffers[buffer]->mLock);
+		mBuffers[buffer]->mEvents.clear();
+		mBuffers[buffer]->mDroppedEvents = 0;
+	}
+}
+void Tracer::writeChromeTrace(ostream& output)
+{
+	std::lock_guard<std::mutex> lock(mRegistryLock);
+	double ticks_per_us = getTickFrequency()/1000000.0;
+	// Timestamps are written relative to the earliest recorded event
+	int64 origin_ticks = 0;
+	bool origin_found = false;
+	for (int buffer=0; buffer < (int) mBuffers.size(); buffer++)
+	{
+		std::lock_guard<std::mutex> buffer_lock(mBuffers[buffer]->mLock);
+		vector<TraceEvent>& events = mBuffers[buffer]->mEvents;
+		for (int event=0; event < (int) events.size(); event++)
+			if (!origin_found || (events[event].mStartTicks < origin_ticks))
+			{
+				origin_ticks = events[event].mStartTicks;
+				origin_found = true;
+			}
+	}
+	output << "{\"traceEvents\": [";
+	output << fixed << setprecision(3);
+	bool first_event = true;
+	for (int buffer=0; buffer < (int) mBuffers.size(); buffer++)
+	{
+		std::lock_guard<std::mutex> buffer_lock(mBuffers[buffer]->mLock);
+		int thread_number = mBuffers[buffer]->mThreadNumber;
+		output << (first_event ? "\n  " : ",\n  ")
+			   << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread_number
+			   << ", \"args\": {\"name\": \"Thread " << thread_number
+			   << " (" << mBuffers[buffer]->mDroppedEvents << " dropped)\"}}";
+		first_event = false;
+		vector<TraceEvent>& events = mBuffers[buffer]->mEvents;
+		for (int event=0; event < (int) events.size(); event++)
+		{
+			output << ",\n  {\"name\": \"" << EscapeJSON(mNames[events[event].mNameId]) << "\""
+				   << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << thread_number
+				   << ", \"ts\": " << ((double) (events[event].mStartTicks-origin_ticks))/ticks_per_us
+				   << ", \"dur\": " << ((double) (events[event].mEndTicks-events[event].mStartTicks))/ticks_per_us << "}";
+		}
+	}
+	output << "\n], \"displayTimeUnit\": \"ms\"}" << endl;
+}
+bool Tracer::exportChromeTrace(String filename)
+{
+	ofstream output(filename.c_str());
+	if (!output.is_open())
+	{
+		cout << "Could not open the trace file for write: " << filename << endl;
+		return false;
+	}
+	writeChromeTrace(output);
+	return true;
+}
+
+TraceScope::TraceScope(int name_id)
+{
+	mNameId = name_id;
+	mStartTicks = getTickCount();
+}
+TraceScope::~TraceScope()
+{
+	Tracer::Record(mNameId, mStartTicks, getTickCount());
+}
+
+
+TimestampEvent::TimestampEvent()
+{
+	Reset("");
+}
+void TimestampEvent::Reset(String event_name)
+{
+	mEventName = event_name;
+	mEventCount = 0;
+	mAverageDuration = 0.0;
+	mLastDuration = 0.0;
+	mTraceNameId = Tracer::RegisterName(event_name);
+	mDurations.Reset();
+}
+void TimestampEvent::RecordEvent(double duration_us)
+{
+	double duration = duration_us/1000.0;
+	mLastDuration = duration;
+	mAverageDuration = ((mAverageDuration*((double) mEventCount))+duration)/((double) (mEventCount+1));
+	mEventCount++;
+	mDurations.RecordValue((int64) (duration_us+0.5));
+}
+int TimestampEvent::getTraceNameId()
+{
+	return mTraceNameId;
+}
+double TimestampEvent::getLastTime()
+{
+	return mLastDuration;
+}
+double TimestampEvent::getAverageTime()
+{
+	return mAverageDuration;
+}
+double TimestampEvent::getPercentileTime(double percentile)
+{
+	return ((double) mDurations.getValueAtPercentile(percentile))/1000.0;
+}
+double TimestampEvent::getMaximumTime()
+{
+	return ((double) mDurations.getMaximum())/1000.0;
+}
+int TimestampEvent::getEventCount()
+{
+	return mEventCount;
+}
+LatencyHistogram& TimestampEvent::getHistogram()
+{
+	return mDurations;
+}
+String TimestampEvent::getEventName()
+{
+	return mEventName;
+}
+String TimestampEvent::getString(bool average, bool last)
+{
+	String event_string;
+	std::ostringstream temp;
+	temp << mEventName;
+	temp.precision(1);
+	if (average || last)
+		temp << " ";
+	if (last)
+		temp << (int) (mLastDuration+0.5) << "ms ";
+	if ((average) && (mEventCount > 1))
+		temp << fixed << "(av. " << mAverageDuration << "ms)";
+	event_string = temp.str();
+	return event_string;
+}
+
+
+Timestamper::Timestamper()
+{
+	mTickFrequency = getTickFrequency()/1000000.0;  // Tick frequency in us
+	reset();
+}
+void Timestamper::reset()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	mEvents.clear();
+	mEventIds.clear();
+	mLastTickCounts.clear();
+	mLastTickCounts[std::this_thread::get_id()] = getTickCount();
+}
+void Timestamper::ignoreTimeSinceLastRecorded()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	mLastTickCounts[std::this_thread::get_id()] = getTickCount();
+}
+int Timestamper::registerEvent(String event)
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	map<String,int>::iterator existing = mEventIds.find(event);
+	if (existing != mEventIds.end())
+		return existing->second;
+	int event_id = (int) mEvents.size();
+	mEvents.push_back(TimestampEvent());
+	mEvents[event_id].Reset(event);
+	mEventIds[event] = event_id;
+	return event_id;
+}
+void Timestamper::recordTime(int event_id)
+{
+	int64 tick_count = getTickCount();
+	std::lock_guard<std::mutex> lock(mLock);
+	std::thread::id thread = std::this_thread::get_id();
+	map<std::thread::id,int64>::iterator last = mLastTickCounts.find(thread);
+	mLastTickCounts[thread] = tick_count;
+	// A thread's first call only starts its clock, as there is nothing to measure from
+	if ((last == mLastTickCounts.end()) || (event_id < 0) || (event_id >= (int) mEvents.size()))
+		return;
+	int64 last_tick_count = last->second;
+	double processing_duration = ((double) (tick_count-last_tick_count))/mTickFrequency;
+	mEvents[event_id].RecordEvent(processing_duration);
+#ifdef ENABLE_TRACING
+	Tracer::Record(mEvents[event_id].getTraceNameId(), last_tick_count, tick_count);
+#endif
+}
+void Timestamper::recordTime(String event)
+{
+	recordTime(registerEvent(event));
+}
+int Timestamper::getEventCount()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	return (int) mEvents.size();
+}
+// Returns a copy, as another thread may register an event (and so move the
+// events) or record a time while the caller is reading it
+TimestampEvent Timestamper::getEvent(int event_id)
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	CV_Assert((event_id >= 0) && (event_id < (int) mEvents.size()));
+	return mEvents[event_id];
+}
+void Timestamper::putTimes(Mat output_image)
+{
+	int line_step = 13;
+	Scalar colour( 0, 0, 255);
+	Point location( 7, 13 );
+	putText( output_image, "Execution times:", location, FONT_HERSHEY_SIMPLEX, 0.4, colour );
+
+	std::lock_guard<std::mutex> lock(mLock);
+
+	for (int event_count = 0; event_count < (int) mEvents.size(); event_count++)
+	{
+		String output = "";
+		output += "-";
+		output += mEvents[event_count].getString();
+		location.y += line_step;
+		putText( output_image, output, location, FONT_HERSHEY_SIMPLEX, 0.4, colour );
+	}
+}
+void Timestamper::writeCSV(ostream& output)
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	output << "event,count,mean_us,min_us,p50_us,p95_us,p99_us,max_us" << endl;
+	for (int event_count = 0; event_count < (int) mEvents.size(); event_count++)
+	{
+		LatencyHistogram& durations = mEvents[event_count].getHistogram();
+		output << "\"" << mEvents[event_count].getEventName() << "\","
+			   << durations.getCount() << ","
+			   << fixed << setprecision(1) << durations.getMean() << ","
+			   << durations.getMinimum() << ","
+			   << durations.getValueAtPercentile(50.0) << ","
+			   << durations.getValueAtPercentile(95.0) << ","
+			   << durations.getValueAtPercentile(99.0) << ","
+			   << durations.getMaximum() << endl;
+	}
+}
+void Timestamper::writeJSON(ostream& output)
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	output << "{\"events\": [";
+	for (int event_count = 0; event_count < (int) mEvents.size(); event_count++)
+	{
+		LatencyHistogram& durations = mEvents[event_count].getHistogram();
+		output << ((event_count > 0) ? ",\n  " : "\n  ")
+			   << "{\"name\": \"" << EscapeJSON(mEvents[event_count].getEventName()) << "\""
+			   << ", \"count\": " << durations.getCount()
+			   << ", \"mean_us\": " << fixed << setprecision(1) << durations.getMean()
+			   << ", \"min_us\": " << durations.getMinimum()
+			   << ", \"p50_us\": " << durations.getValueAtPercentile(50.0)
+			   << ", \"p95_us\": " << durations.getValueAtPercentile(95.0)
+			   << ", \"p99_us\": " << durations.getValueAtPercentile(99.0)
+			   << ", \"max_us\": " << durations.getMaximum() << "}";
+	}
+	output << "\n]}" << endl;
+}
+bool Timestamper::exportTimes(String filename)
+{
+	ofstream output(filename.c_str());
+	if (!output.is_open())
+	{
+		cout << "Could not open the timing file for write: " << filename << endl;
+		return false;
+	}
+	String extension = (filename.size() >= 5) ? filename.substr(filename.size()-5) : "";
+	if (extension == ".json")
+		writeJSON(output);
+	else writeCSV(output);
+	return true;
+}
+
+// Images with fewer values than this are processed on the calling thread, as
+// the parallel overhead would outweigh the work
+#define PARALLEL_MINIMUM_VALUES (256*1024)
+
+static void RunOverRows( Mat& image, const ParallelLoopBody& body )
+{
+	if (image.total()*image.channels() < PARALLEL_MINIMUM_VALUES)
+		body(Range(0, image.rows));
+	else parallel_for_(Range(0, image.rows), body);
+}
+
+// The smallest and largest values in one 8 bit or float row
+static void FindRowRange( const uchar* row, int number_of_values, int& minimum, int& maximum )
+{
+	int value = 0;
+#if CV_SSE2
+	if (number_of_values >= 16)
+	{
+		__m128i minimums = _mm_set1_epi8((char) minimum), maximums = _mm_set1_epi8((char) maximum);
+		for (; value <= number_of_values-16; value += 16)
+		{
+			__m128i values = _mm_loadu_si128((const __m128i*) (row+value));
+			minimums = _mm_min_epu8(minimums, values);
+			maximums = _mm_max_epu8(maximums, values);
+		}
+		uchar lanes[32];
+		_mm_storeu_si128((__m128i*) lanes, minimums);
+		_mm_storeu_si128((__m128i*) (lanes+16), maximums);
+		for (int lane=0; lane < 16; lane++)
+		{
+			minimum = std::min(minimum, (int) lanes[lane]);
+			maximum = std::max(maximum, (int) lanes[lane+16]);
+		}
+	}
+#endif
+	for (; value < number_of_values; value++)
+	{
+		minimum = std::min(minimum, (int) row[value]);
+		maximum = std::max(maximum, (int) row[value]);
+	}
+}
+
+static void FindRowRange( const float* row, int number_of_values, float& minimum, float& maximum )
+{
+	int value = 0;
+#if CV_SSE2
+	if (number_of_values >= 4)
+	{
+		__m128 minimums = _mm_set1_ps(minimum), maximums = _mm_set1_ps(maximum);
+		for (; value <= number_of_values-4; value += 4)
+		{
+			__m128 values = _mm_loadu_ps(row+value);
+			minimums = _mm_min_ps(minimums, values);
+			maximums = _mm_max_ps(maximums, values);
+		}
+		float lanes[8];
+		_mm_storeu_ps(lanes, minimums);
+		_mm_storeu_ps(lanes+4, maximums);
+		for (int lane=0; lane < 4; lane++)
+		{
+			minimum = std::min(minimum, lanes[lane]);
+			maximum = std::max(maximum, lanes[lane+4]);
+		}
+	}
+#endif
+	for (; value < number_of_values; value++)
+	{
+		minimum = std::min(minimum, row[value]);
+		maximum = std::max(maximum, row[value]);
+	}
+}
+
+// Each band of rows finds its own range and then merges it into the total
+class ImageRangeBody : public ParallelLoopBody
+{
+private:
+	Mat& mImage;
+	double& mMinimum;
+	double& mMaximum;
+	mutable std::mutex mLock;
+public:
+	ImageRangeBody( Mat& image, double& minimum, double& maximum ) :
+		mImage(image), mMinimum(minimum), mMaximum(maximum)
+	{
+	}
+	void operator()( const Range& rows ) const
+	{
+		int number_of_values = mImage.cols*mImage.channels();
+		double minimum, maximum;
+		if (mImage.depth() == CV_8U)
+		{
+			int row_minimum = 255, row_maximum = 0;
+			for (int row=rows.start; row < rows.end; row++)
+				FindRowRange(mImage.ptr<uchar>(row), number_of_values, row_minimum, row_maximum);
+			minimum = row_minimum;
+			maximum = row_maximum;
+		}
+		else
+		{
+			float row_minimum = FLT_MAX, row_maximum = -FLT_MAX;
+			for (int row=rows.start; row < rows.end; row++)
+				FindRowRange(mImage.ptr<float>(row), number_of_values, row_minimum, row_maximum);
+			minimum = row_minimum;
+			maximum = row_maximum;
+		}
+		std::lock_guard<std::mutex> lock(mLock);
+		mMinimum = std::min(mMinimum, minimum);
+		mMaximum = std::max(mMaximum, maximum);
+	}
+};
+
+// Finds the smallest and largest values over all channels of an 8 bit or float
+// image.  An empty image has a range of 0 to 0.
+void FindImageRange( Mat& image, double& minimum, double& maximum )
+{
+	CV_Assert((image.depth() == CV_8U) || (image.depth() == CV_32F));
+	if (image.empty())
+	{
+		minimum = maximum = 0.0;
+		return;
+	}
+	minimum = DBL_MAX;
+	maximum = -DBL_MAX;
+	ImageRangeBody body(image, minimum, maximum);
+	RunOverRows(image, body);
+}
+
+// Each band of rows is looked up in place by LUT, which is vectorised
+class LookupRowsBody : public ParallelLoopBody
+{
+private:
+	Mat& mImage;
+	Mat mTable;
+public:
+	LookupRowsBody( Mat& image, Mat& table ) :
+		mImage(image), mTable(table)
+	{
+	}
+	void operator()( const Range& rows ) const
+	{
+		Mat band = mImage.rowRange(rows.start, rows.end);
+		LUT(band, mTable, band);
+	}
+};
+
+// Stretches an 8 bit image in place so that its largest value becomes 255.  A
+// black image is left black.
+void StretchImageInPlace( Mat& image )
+{
+	CV_Assert(image.depth() == CV_8U);
+	double minimum, maximum;
+	FindImageRange(image, minimum, maximum);
+	if ((maximum <= 0.0) || (maximum >= 255.0))
+		return;
+	Mat table(1, 256, CV_8U);
+	for (int i=0; (i<256); i++)
+		table.at<uchar>(i) = saturate_cast<uchar>((255*i)/(int) maximum);
+	LookupRowsBody body(image, table);
+	RunOverRows(image, body);
+}
+
+Mat StretchImage( Mat& image )
+{
+	Mat result = image.clone();
+	StretchImageInPlace(result);
+	return result;
+}
+
+// Converts float values to 8 bits as value*scale + shift, saturating and
+// rounding to nearest as convertTo does
+class ScaleToBytesBody : public ParallelLoopBody
+{
+private:
+	Mat& mImage;
+	Mat& mResult;
+	float mScale;
+	float mShift;
+public:
+	ScaleToBytesBody( Mat& image, Mat& result, float scale, float shift ) :
+		mImage(image), mResult(result), mScale(scale), mShift(shift)
+	{
+	}
+	void operator()( const Range& rows ) const
+	{
+		int number_of_values = mImage.cols*mImage.channels();
+		for (int row=rows.start; row < rows.end; row++)
+		{
+			const float* input = mImage.ptr<float>(row);
+			uchar* output = mResult.ptr<uchar>(row);
+			int value = 0;
+#if CV_SSE2
+			__m128 scale = _mm_set1_ps(mScale), shift = _mm_set1_ps(mShift);
+			for (; value <= number_of_values-16; value += 16)
+			{
+				__m128i values0 = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(input+value), scale), shift));
+				__m128i values1 = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(input+value+4), scale), shift));
+				__m128i values2 = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(input+value+8), scale), shift));
+				__m128i values3 = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(input+value+12), scale), shift));
+				_mm_storeu_si128((__m128i*) (output+value),
+					_mm_packus_epi16(_mm_packs_epi32(values0, values1), _mm_packs_epi32(values2, values3)));
+			}
+#endif
+			for (; value < number_of_values; value++)
+				output[value] = saturate_cast<uchar>(input[value]*mScale + mShift);
+		}
+	}
+};
+
+// Converts a float image for display into display_image, which is reused if it
+// is already the right size and type.  Unless a scale factor is given, the
+// values are scaled so that the one furthest from zero maps to 255, with zero
+// mapping to zero_maps_to; an image which is all zero is not scaled at all.
+void convert_32bit_image_for_display( Mat& passed_image, Mat& display_image, double zero_maps_to, double passed_scale_factor )
+{
+	double scale_factor = passed_scale_factor;
+	if (passed_scale_factor == -1.0)
+	{
+		double minimum,maximum;
+		if (passed_image.depth() == CV_32F)
+			FindImageRange(passed_image, minimum, maximum);
+		else minMaxLoc(passed_image,&minimum,&maximum);
+		double largest = max(-minimum,maximum);
+		scale_factor = (largest > 0.0) ? (255.0-zero_maps_to)/largest : 0.0;
+	}
+	if (passed_image.depth() != CV_32F)
+	{
+		passed_image.convertTo(display_image, CV_8U, scale_factor, zero_maps_to);
+		return;
+	}
+	display_image.create(passed_image.size(), CV_MAKETYPE(CV_8U, passed_image.channels()));
+	ScaleToBytesBody body(passed_image, display_image, (float) scale_factor, (float) zero_maps_to);
+	RunOverRows(passed_image, body);
+}
+
+Mat convert_32bit_image_for_display(Mat& passed_image, double zero_maps_to/*=0.0*/, double passed_scale_factor/*=-1.0*/ )
+{
+	Mat display_image;
+	convert_32bit_image_for_display(passed_image, display_image, zero_maps_to, passed_scale_factor);
+	return display_image;
+}
+
+void show_32bit_image( char* window_name, Mat& passed_image, double zero_maps_to/*=0.0*/, double passed_scale_factor/*=-1.0*/ )
+{
+	Mat display_image = convert_32bit_image_for_display(passed_image,  zero_maps_to, passed_scale_factor );
+	imshow( window_name, display_image );
+}
+
+// The edges are found with one multispectral Canny: for colour input opencv's
+// Canny takes the gradient of whichever channel responds most strongly at each
+// pixel, and then applies the non-maxima suppression and hysteresis once, so
+// there is no need for a Canny per channel and ORing the results.  The edges
+// are then ORed into every channel of the input in a single pass.
+Mat ComputeDefaultImage( Mat& passed_image )
+{
+	Mat five_by_five_element(5,5,CV_8U,Scalar(1));
+	Mat opened_image, multispectral_edges;
+	morphologyEx(passed_image,opened_image,MORPH_OPEN,five_by_five_element);
+	Canny(opened_image,multispectral_edges,50,120);
+	Mat default_image(passed_image.size(), passed_image.type());
+	int channels = passed_image.channels();
+	CV_Assert(passed_image.depth() == CV_8U);
+	for (int row=0; row < passed_image.rows; row++)
+	{
+		const uchar* input = passed_image.ptr<uchar>(row);
+		const uchar* edges = multispectral_edges.ptr<uchar>(row);
+		uchar* output = default_image.ptr<uchar>(row);
+		for (int column=0; column < passed_image.cols; column++)
+			for (int channel=0; channel < channels; channel++, input++, output++)
+				*output = *input | edges[column];
+	}
+	return default_image;
+}
+
+	void DrawHistogram( MatND histograms[], int number_of_histograms, Mat& display_image )
+	{
+		int number_of_bins = histograms[0].size[0];
+		double max_value=0, min_value=0;
+		double channel_max_value=0, channel_min_value=0;
+		for (int channel=0; (channel < number_of_histograms); channel++)
+		{
+			minMaxLoc(histograms[channel], &channel_min_value, &channel_max_value, 0, 0);
+			max_value = ((max_value > channel_max_value) && (channel > 0)) ? max_value : channel_max_value;
+			min_value = ((min_value < channel_min_value) && (channel > 0)) ? min_value : channel_min_value;
+		}
+		float scaling_factor = ((float)256.0)/((float)number_of_bins);
+		
+		Mat histogram_image((int)(((float)number_of_bins)*scaling_factor),(int)(((float)number_of_bins)*scaling_factor),CV_8UC3,Scalar(255,255,255));
+		display_image = histogram_image;
+		int highest_point = static_cast<int>(0.9*((float)number_of_bins)*scaling_factor);
+		for (int channel=0; (channel < number_of_histograms); channel++)
+		{
+			int last_height;
+			for( int h = 0; h < number_of_bins; h++ )
+			{
+				float value = histograms[channel].at<float>(h);
+				int height = static_cast<int>(value*highest_point/max_value);
+				int where = (int)(((float)h)*scaling_factor);
+				if (h > 0)
+					line(histogram_image,Point((int)(((float)(h-1))*scaling_factor),(int)(((float)number_of_bins)*scaling_factor)-last_height),
+								         Point((int)(((float)h)*scaling_factor),(int)(((float)number_of_bins)*scaling_factor)-height),
+							             Scalar(channel==0?255:0,channel==1?255:0,channel==2?255:0));
+				last_height = height;
+			}
+		}
+	}
@@ -0,0 +1,198 @@
+/*
+ * This code is provided as part of "A Practical Introduction to Computer Vision with OpenCV"
+ * by Kenneth Dawson-Howe  Wiley & Sons Inc. 2014.  All rights reserved.
+ */
+#ifndef UTILITIES_H
+#define UTILITIES_H
+
+#include "opencv2/core.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/video.hpp"
+#include "opencv2/objdetect.hpp"
+#include "opencv2/highgui.hpp"
+#include <stdio.h>
+#include <iostream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <pthread.h>
+#define PI 3.14159265358979323846
+
+using namespace std;
+using namespace cv;
+
+void writeText( Mat image, char* text, int row, int column, Scalar colour=-1.0, double scale=0.4, int thickness=1 );
+Mat JoinImagesHorizontally( Mat& image1, char* name1, Mat& image2, char* name2, int spacing=0, Scalar colour=-1.0 );
+Mat JoinImagesVertically( Mat& image1, char* name1, Mat& image2, char* name2, int spacing=0, Scalar colour=-1.0 );
+void addGaussianNoise(Mat &image, double average=0.0, double standard_deviation=10.0);
+bool ReadJPEGSize( String filename, Size& image_size );
+int ChooseReducedReadFlags( Size image_size, Size minimum_size, int flags=IMREAD_COLOR );
+Mat ReadImageAtScale( String filename, Size minimum_size, int flags=IMREAD_COLOR );
+
+VideoWriter* OpenVideoFile( char* filename, VideoCapture& video_to_emulate, int horizontal_multiple=1, int vertical_multiple=1, int spacing=0 );
+VideoWriter* OpenVideoFile( char* filename, int codec, Size image_size, double fps, int horizontal_multiple=1, int vertical_multiple=1, int spacing=0 );
+void WriteVideoFrame( VideoWriter* output_video, Mat& video_frame );
+void CloseVideoFile( VideoWriter* video );
+
+void invertImage(Mat &image, Mat &result_image);
+void ImagesDemos( Mat& image1, Mat& image2, Mat& logo_image, Mat& people_image );
+void HistogramsDemos( Mat& dark_image, Mat& fruit_image, Mat& people_image, Mat& skin_image, Mat all_images[], int number_of_images );
+void BinaryDemos(Mat& pcb_image, Mat& stationery_image );
+void GeometricDemos( Mat& image1, Mat& image2, Mat& image3 );
+void VideoDemos( VideoCapture& surveillance_video, int starting_frame, bool clean_binary_images );
+void EdgeDemos( Mat& image1, Mat& image2 );
+void FeaturesDemos( Mat& image1, Mat& image2, Mat& image3 );
+void RecognitionDemos( Mat& full_image, Mat& template1, Mat& template2, Mat& template1locations, Mat& template2locations, VideoCapture& bicycle_video, Mat& bicycle_background, Mat& bicycle_model, VideoCapture& people_video, CascadeClassifier& cascade, Mat& numbers, Mat& good_orings, Mat& bad_orings, Mat& unknown_orings );
+void MeanShiftDemo( VideoCapture& video, Rect& starting_position, int starting_frame, int end_frame);
+int CameraCalibration( string passed_settings_filename );
+void TrackFeaturesDemo( VideoCapture& video, int starting_frame_number, int ending_frame_number );
+
+// HDR-style latency histogram.  Each power of two is split into
+// LATENCY_SUB_BUCKETS linear buckets, so any recorded value can be read back
+// to within 1/LATENCY_SUB_BUCKETS of itself while the table stays a fixed size.
+#define LATENCY_SUB_BUCKET_BITS 6
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAGNITUDES 33
+class LatencyHistogram {
+private:
+	vector<int64> mCounts;
+	int64 mTotalCount;
+	int64 mMinimumValue;
+	int64 mMaximumValue;
+	double mSum;
+	int getBucketIndex(int64 value);
+	int64 getHighestValueInBucket(int index);
+public:
+	LatencyHistogram();
+	void Reset();
+	void RecordValue(int64 value);
+	int64 getCount();
+	int64 getMinimum();
+	int64 getMaximum();
+	double getMean();
+	int64 getValueAtPercentile(double percentile);
+};
+
+// Per-thread trace buffers, exported in the Chrome trace-event format so that
+// overlapping stages can be inspected in chrome://tracing.  Events are only
+// recorded when ENABLE_TRACING is defined; otherwise TRACE_SCOPE compiles to
+// nothing.  Each thread appends to its own buffer, so recording never waits on
+// another thread.
+#define TRACE_BUFFER_CAPACITY 1000000
+struct TraceEvent {
+	int mNameId;
+	int64 mStartTicks;
+	int64 mEndTicks;
+};
+
+struct TraceBuffer {
+	int mThreadNumber;
+	int mDroppedEvents;
+	vector<TraceEvent> mEvents;
+	std::mutex mLock;
+};
+
+class Tracer {
+private:
+	static std::mutex mRegistryLock;
+	static vector<TraceBuffer*> mBuffers;
+	static vector<String> mNames;
+	static map<String,int> mNameIds;
+	static pthread_key_t mThreadBufferKey;
+	static pthread_once_t mThreadBufferKeyOnce;
+	static void CreateThreadBufferKey();
+	static TraceBuffer* getThreadBuffer();
+public:
+	static int RegisterName(String name);
+	static void Record(int name_id, int64 start_ticks, int64 end_ticks);
+	static void Clear();
+	static void writeChromeTrace(ostream& output);
+	static bool exportChromeTrace(String filename);
+};
+
+class TraceScope {
+private:
+	int mNameId;
+	int64 mStartTicks;
+public:
+	TraceScope(int name_id);
+	~TraceScope();
+};
+
+#ifdef ENABLE_TRACING
+#define TRACE_CONCATENATE_(first, second) first##second
+#define TRACE_CONCATENATE(first, second) TRACE_CONCATENATE_(first, second)
+#define TRACE_SCOPE(name) \
+	static int TRACE_CONCATENATE(trace_name_id_, __LINE__) = Tracer::RegisterName(name); \
+	TraceScope TRACE_CONCATENATE(trace_scope_, __LINE__)(TRACE_CONCATENATE(trace_name_id_, __LINE__))
+#else
+#define TRACE_SCOPE(name)
+#endif
+
+class TimestampEvent {
+private:
+	String mEventName;
+	double mAverageDuration;
+	double mLastDuration;
+	int mEventCount;
+	int mTraceNameId;
+	LatencyHistogram mDurations;
+public:
+	TimestampEvent();
+	void Reset(String event_name);
+	void RecordEvent(double duration_us);
+	int getTraceNameId();
+	double getLastTime();
+	double getAverageTime();
+	double getPercentileTime(double percentile);
+	double getMaximumTime();
+	int getEventCount();
+	LatencyHistogram& getHistogram();
+	String getEventName();
+	String getString(bool average=true, bool last=true);
+};
+
+
+// Durations are measured in microseconds and kept per event in a
+// LatencyHistogram.  Events are either looked up by name, or registered once
+// with registerEvent() and then recorded by the returned ID in constant time.
+// The time since the last recorded event is tracked separately for each
+// thread, so one Timestamper can be shared by concurrent pipeline stages.  Each
+// recorded interval is also emitted as a trace event when tracing is enabled.
+class Timestamper {
+private:
+	vector<TimestampEvent> mEvents;
+	map<String,int> mEventIds;
+	map<std::thread::id,int64> mLastTickCounts;
+	double mTickFrequency;
+	std::mutex mLock;
+public:
+	Timestamper();
+	void reset();
+	void ignoreTimeSinceLastRecorded();
+	int registerEvent(String event);
+	void recordTime(int event_id);
+	void recordTime(String event = "");
+	int getEventCount();
+	TimestampEvent getEvent(int event_id);
+	void putTimes(Mat output_image);
+	void writeCSV(ostream& output);
+	void writeJSON(ostream& output);
+	bool exportTimes(String filename);
+};
+
+String EscapeJSON( String text );
+void invertImage(Mat &image, Mat &result_image);
+void FindImageRange( Mat& image, double& minimum, double& maximum );
+void StretchImageInPlace( Mat& image );
+Mat StretchImage( Mat& image );
+void convert_32bit_image_for_display( Mat& passed_image, Mat& display_image, double zero_maps_to=0.0, double passed_scale_factor=-1.0 );
+Mat convert_32bit_image_for_display(Mat& passed_image, double zero_maps_to=0.0, double passed_scale_factor=-1.0 );
+void show_32bit_image( char* window_name, Mat& passed_image, double zero_maps_to=0.0, double passed_scale_factor=-1.0 );
+Mat ComputeDefaultImage( Mat& passed_image );
+void DrawHistogram( MatND histograms[], int number_of_histograms, Mat& display_image );
+
+#endif
@@ -0,0 +1,601 @@
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <ctype.h>
+#include <stdio.h>
+#include <float.h>
+#include <string.h>
+
+#include "../CV Common/Utilities.h"
+#include "../CV Common/ResultCache.h"
+
+using namespace cv;
+using namespace std;
+
+#define BW_THRESH_RATIO	0.7
+#define LABEL_THRESH	25
+// the most image data (in bytes) read at a time when large images are
+// processed in strips of rows
+#define STRIP_BYTES		(1 << 20)
+
+/**
+ finds the 'midpoint' (center point) of each bottle in the input matrix
+ 
+ @param img input matrix
+ 
+ @return the x coordinates of the midpoints of the bottles
+ */
+vector<int> getMidpoints(Mat img) {
+	TRACE_SCOPE("getMidpoints");
+	Mat gray, binary, top_binary;
+	
+	// perform an otsu threshold on the image to make it binary
+	cvtColor(img, gray, CV_BGR2GRAY);
+	threshold(gray, binary, 0, 255, THRESH_BINARY|THRESH_OTSU);
+	
+	// focus on the top 20% of the image (the tops of the bottle caps) since
+	// each bottle is very easily discernable there
+	Rect top = Rect(0, 0, binary.cols, binary.rows * 0.2);
+	top_binary = binary(top);
+	
+	// perform kmeans with just one center, so that the 'centers' output matrix
+	// is only one pixel in height
+	int k = 1, attempts = 1;
+	Mat labels, centers;
+	top_binary.convertTo(top_binary, CV_32F);
+	kmeans(top_binary, k, labels,
+		   TermCriteria(CV_TERMCRIT_ITER|CV_TERMCRIT_EPS, 10000, 0.0001),
+		   attempts, KMEANS_PP_CENTERS, centers);
+	
+	// get the coordinates of the white pixels only. these are the tops of the
+	// bottle caps
+	centers.convertTo(centers, CV_8UC1);
+	std::vector<cv::Point2i> locations;
+	findNonZero(centers, locations);
+	
+	// figure out the centre point of each cluster of white pixels
+	vector<int> midpoints;
+	int prev = 0, start = -1;
+	for (int i = 0; i < locations.size(); i++) {
+		int p = locations[i].x;
+		if (start == -1) {
+			start = p;
+		}
+		// assumes that no two bottlecaps will be closer than 10 pixels together
+		else if (p - prev > 10 || i == locations.size() - 1) {
+			midpoints.push_back(((prev-start)/2)+start);
+			start = p;
+		}
+		prev = p;
+	}
+	
+	return midpoints;
+}
+
+/**
+ finds bounding boxes for each bottle in an image of multiple bottles
+ 
+ @param img input matrix
+ @param midpoints the midpoint of each bottle in the input matrix
+ 
+ @return a vector of bounding boxes that each fit around one glue bottle in
+	the input matrix
+ */
+vector<Rect> getBounds(Size img, vector<int> midpoints) {
+	vector<Rect> bounds;
+	
+	// handle edge case where there's only one bottle in the input matrix
+	if (midpoints.size() == 1) {
+		bounds.push_back(Rect(0, 0, img.width, img.height));
+		return bounds;
+	}
+	
+	int prev_start = 0;
+	for (int i = 1; i < midpoints.size(); i++) {
+		// get the rect around the previous midpoint
+		Rect r = Rect(prev_start, 0,
+					  ((midpoints[i-1]+midpoints[i])/2)-prev_start, img.height);
+		bounds.push_back(r);
+		prev_start = (midpoints[i-1]+midpoints[i])/2;
+		
+		// handle the last midpoint in the image
+		if (i == midpoints.size() - 1) {
+			bounds.push_back(Rect(prev_start, 0,
+								  img.width-prev_start, img.height));
+		}
+	}
+	return bounds;
+}
+
+vector<Rect> getBounds(Mat img, vector<int> midpoints) {
+	return getBounds(img.size(), midpoints);
+}
+
+/**
+ builds the table of which (maximum, minimum) channel pairs make a label
+ pixel. getRatio used to convert each bottle to HLS, zero the hue and
+ luminance, convert back to grey and threshold at LABEL_THRESH. the saturation
+ only depends on the largest and smallest of the three channels, and the grey
+ level of (0, 0, S) is (S*4899 + 8192) >> 14, so the whole test can be looked
+ up. the saturation is computed as opencv's cvtColor does for 8 bit images
+ 
+ @return 256*256 table indexed by maximum*256 + minimum, 1 for label pixels
+ */
+vector<uchar> buildLabelTable() {
+	vector<uchar> table(256*256, 0);
+	for (int maximum = 0; maximum < 256; maximum++) {
+		for (int minimum = 0; minimum <= maximum; minimum++) {
+			float vmax = maximum*(1.f/255), vmin = minimum*(1.f/255);
+			float diff = vmax - vmin, l = (vmax + vmin)*0.5f, s = 0;
+			if (diff > FLT_EPSILON)
+				s = (l < 0.5f) ? diff/(vmax + vmin) : diff/(2 - vmax - vmin);
+			int saturation = saturate_cast<uchar>(s*255);
+			int gray = (saturation*4899 + (1 << 13)) >> 14;
+			table[maximum*256 + minimum] = (gray > LABEL_THRESH) ? 1 : 0;
+		}
+	}
+	return table;
+}
+
+/**
+ classifies every pixel of the image as label or not in one pass, building the
+ summed-area table of the label pixels as it goes, so that the ratio of any
+ rectangle can then be found in constant time
+ 
+ @param img input matrix (BGR)
+ 
+ @return (rows+1)x(cols+1) CV_32S table, where (y, x) is the number of label
+ pixels above and to the left of pixel (y, x)
+ */
+Mat getLabelIntegral(Mat img) {
+	TRACE_SCOPE("getLabelIntegral");
+	CV_Assert(img.type() == CV_8UC3);
+	static const vector<uchar> table = buildLabelTable();
+	Mat integral(img.rows+1, img.cols+1, CV_32S);
+	int* above = integral.ptr<int>(0);
+	memset(above, 0, integral.cols*sizeof(int));
+	for (int y = 0; y < img.rows; y++) {
+		const uchar* pixel = img.ptr<uchar>(y);
+		int* row = integral.ptr<int>(y+1);
+		row[0] = 0;
+		int row_count = 0;
+		for (int x = 0; x < img.cols; x++, pixel += 3) {
+			int maximum = max(max(pixel[0], pixel[1]), pixel[2]);
+			int minimum = min(min(pixel[0], pixel[1]), pixel[2]);
+			row_count += table[maximum*256 + minimum];
+			row[x+1] = above[x+1] + row_count;
+		}
+		above = row;
+	}
+	return integral;
+}
+
+/**
+ gets the percentage of label pixels in any rectangle of the image
+ 
+ @param integral summed-area table from getLabelIntegral
+ @param region rectangle of the image
+ 
+ @return percentage of the pixels in the region which are label pixels
+ */
+double getRegionRatio(Mat& integral, Rect region) {
+	region &= Rect(0, 0, integral.cols-1, integral.rows-1);
+	if (region.area() == 0)
+		return 0;
+	int count = integral.at<int>(region.y + region.height, region.x + region.width)
+			  - integral.at<int>(region.y, region.x + region.width)
+			  - integral.at<int>(region.y + region.height, region.x)
+			  + integral.at<int>(region.y, region.x);
+	return ((double)count/(double)region.area())*100;
+}
+
+/**
+ gets the amount of white pixels with respect to the total amount of pixels in
+ the thresholded bottle, irrespective of luminance
+ 
+ @param integral summed-area table from getLabelIntegral
+ @param bottle bounding box of the bottle
+ 
+ @return ratio of white pixels to total pixels in the bottle's face
+ */
+double getRatio(Mat& integral, Rect bottle) {
+	// only the bottom square of the bottle, which contains the face of the
+	// bottle, is scored
+	Rect face = Rect(bottle.x, bottle.y + bottle.height - bottle.width,
+					 bottle.width, bottle.width);
+	return getRegionRatio(integral, face);
+}
+
+/**
+ picks out the bottles whose threshold ratio falls below BW_THRESH_RATIO,
+ which have no label
+ 
+ @param bounds the bounding box of each bottle
+ @param ratios the white pixel ratio of each bottle in bounds
+ 
+ @return the bounding boxes of the bottles with no label
+ */
+vector<Rect> getUnlabelledBottles(vector<Rect>& bounds, vector<double>& ratios) {
+	vector<Rect> no_label;
+	for (int j = 0; j < bounds.size(); j++) {
+		if (ratios[j] < BW_THRESH_RATIO) {
+			no_label.push_back(bounds[j]);
+		}
+	}
+	return no_label;
+}
+
+/**
+ finds every bottle in an image and scores its label
+ 
+ @param img input matrix
+ @param bounds output: the bounding box of each bottle in the input matrix
+ @param ratios output: the white pixel ratio of each bottle in bounds
+ @param timer optional timer that each stage of the inspection is recorded to
+ 
+ @return the bounding boxes of the bottles with no label
+ */
+vector<Rect> inspectBottles(Mat img, vector<Rect>& bounds, vector<double>& ratios,
+							Timestamper* timer = NULL) {
+	vector<int> midpoints = getMidpoints(img);
+	if (timer) timer->recordTime("Midpoints");
+	// find the bounding box for each bottle in the image
+	bounds = getBounds(img, midpoints);
+	if (timer) timer->recordTime("Bounds");
+	
+	// the whole image is thresholded once, and then each bottle's ratio is
+	// read from the summed-area table
+	Mat integral = getLabelIntegral(img);
+	ratios.clear();
+	for (int j = 0; j < bounds.size(); j++) {
+		ratios.push_back(getRatio(integral, bounds[j]));
+	}
+	if (timer) timer->recordTime("Ratios");
+	return getUnlabelledBottles(bounds, ratios);
+}
+
+/**
+ describes the inspection and its parameters, so that cached results are only
+ used by the same version of the inspection
+ 
+ @return the version string for a ResultCache
+ */
+string getInspectionVersion() {
+	ostringstream version;
+	version << "lab2-inspection 2 bw_thresh_ratio=" << BW_THRESH_RATIO
+			<< " label_thresh=" << LABEL_THRESH;
+	return version.str();
+}
+
+/**
+ looks up the inspection of an image in a cache. each bottle is cached as its
+ x, y, width, height and ratio
+ 
+ @param cache cache made with getInspectionVersion
+ @param content_hash hash of the image file or image
+ @param bounds output: the bounding box of each bottle
+ @param ratios output: the white pixel ratio of each bottle
+ 
+ @return true if the inspection was cached
+ */
+bool getCachedInspection(ResultCache& cache, uint64 content_hash,
+						 vector<Rect>& bounds, vector<double>& ratios) {
+	vector<double> values;
+	if (!cache.Lookup(content_hash, values) || values.size() % 5 != 0)
+		return false;
+	bounds.clear();
+	ratios.clear();
+	for (int j = 0; j < values.size(); j += 5) {
+		bounds.push_back(Rect((int)values[j], (int)values[j+1],
+							  (int)values[j+2], (int)values[j+3]));
+		ratios.push_back(values[j+4]);
+	}
+	return true;
+}
+
+/**
+ stores the inspection of an image in a cache, as read by getCachedInspection
+ */
+void cacheInspection(ResultCache& cache, uint64 content_hash,
+					 vector<Rect>& bounds, vector<double>& ratios) {
+	vector<double> values;
+	for (int j = 0; j < bounds.size(); j++) {
+		values.push_back(bounds[j].x);
+		values.push_back(bounds[j].y);
+		values.push_back(bounds[j].width);
+		values.push_back(bounds[j].height);
+		values.push_back(ratios[j]);
+	}
+	cache.Store(content_hash, values);
+}
+
+// reads a binary (P6) PPM image in horizontal strips of whole rows, straight
+// from the file a strip at a time, so only one strip is ever in memory. the
+// strips of a pass are read in order, so the file is read sequentially.
+// compressed formats can't be decoded a strip at a time here, so they aren't
+// read at all rather than being decoded whole
+class StripReader {
+public:
+	StripReader() {
+		rows = cols = 0;
+		data_offset = 0;
+		next_row = 0;
+	}
+	bool open(string filename);
+	bool readStrip(int y, int height, Mat& strip);
+	int getRows() {
+		return rows;
+	}
+	int getCols() {
+		return cols;
+	}
+	// the number of rows in a strip of at most the given number of bytes
+	int getStripRows(int strip_bytes) {
+		return max(1, min(rows, strip_bytes/(cols*3)));
+	}
+	
+private:
+	bool readPPMHeader();
+	
+	ifstream file;
+	streamoff data_offset;
+	int rows;
+	int cols;
+	int next_row;
+};
+
+// reads the header of a binary PPM (with comments) leaving the file at the
+// first pixel
+bool StripReader::readPPMHeader() {
+	char magic[2];
+	if (!file.read(magic, 2) || magic[0] != 'P' || magic[1] != '6')
+		return false;
+	int values[3];
+	for (int i = 0; i < 3; i++) {
+		int c = file.get();
+		while (c == '#' || isspace(c)) {
+			if (c == '#')
+				while (c != '\n' && c != EOF)
+					c = file.get();
+			c = file.get();
+		}
+		if (!isdigit(c))
+			return false;
+		values[i] = 0;
+		for (; isdigit(c); c = file.get())
+			values[i] = values[i]*10 + (c - '0');
+	}
+	// exactly one whitespace character separates the header from the pixels
+	cols = values[0];
+	rows = values[1];
+	data_offset = file.tellg();
+	next_row = 0;
+	return values[2] == 255 && cols > 0 && rows > 0;
+}
+
+bool StripReader::open(string filename) {
+	file.open(filename.c_str(), ios::binary);
+	if (!file.is_open()) {
+		cout << "Could not read the image: " << filename << endl;
+		return false;
+	}
+	if (!readPPMHeader()) {
+		cout << "Only binary (P6) PPM images can be read in strips: "
+			<< filename << endl;
+		file.close();
+		return false;
+	}
+	return true;
+}
+
+/**
+ reads a horizontal strip of the image. the file is only seeked when the
+ strip doesn't follow on from the last one read
+ 
+ @param y the first row of the strip
+ @param height the number of rows in the strip
+ @param strip output: height x cols BGR image
+ 
+ @return false if the strip couldn't be read
+ */
+bool StripReader::readStrip(int y, int height, Mat& strip) {
+	TRACE_SCOPE("StripReader::readStrip");
+	CV_Assert(y >= 0 && height > 0 && y + height <= rows);
+	if (y != next_row) {
+		file.clear();
+		file.seekg(data_offset + (streamoff)y*cols*3);
+	}
+	strip.create(height, cols, CV_8UC3);
+	if (!file.read((char*)strip.data, (streamsize)height*cols*3)) {
+		next_row = -1;
+		return false;
+	}
+	next_row = y + height;
+	// PPM pixels are RGB
+	uchar* pixel = strip.data;
+	for (size_t i = 0; i < (size_t)height*cols; i++, pixel += 3)
+		swap(pixel[0], pixel[2]);
+	return true;
+}
+
+/**
+ finds the otsu threshold of a grey level histogram, as opencv's threshold
+ does with THRESH_OTSU
+ 
+ @param histogram the number of pixels at each grey level
+ 
+ @return the threshold
+ */
+int getOtsuThreshold(const vector<int64>& histogram) {
+	double total = 0, mu = 0;
+	for (int i = 0; i < 256; i++) {
+		total += histogram[i];
+		mu += i*(double)histogram[i];
+	}
+	if (total == 0)
+		return 0;
+	double scale = 1./total;
+	mu *= scale;
+	double mu1 = 0, q1 = 0, max_sigma = 0;
+	int max_val = 0;
+	for (int i = 0; i < 256; i++) {
+		double p_i = histogram[i]*scale;
+		mu1 *= q1;
+		q1 += p_i;
+		double q2 = 1. - q1;
+		if (min(q1, q2) < FLT_EPSILON || max(q1, q2) > 1. - FLT_EPSILON)
+			continue;
+		mu1 = (mu1 + i*p_i)/q1;
+		double mu2 = (mu - q1*mu1)/q2;
+		double sigma = q1*q2*(mu1 - mu2)*(mu1 - mu2);
+		if (sigma > max_sigma) {
+			max_sigma = sigma;
+			max_val = i;
+		}
+	}
+	return max_val;
+}
+
+// the grey level of a BGR pixel, as cvtColor computes it for 8 bit images
+static inline int grayLevel(const uchar* pixel) {
+	return (pixel[0]*1868 + pixel[1]*9617 + pixel[2]*4899 + (1 << 13)) >> 14;
+}
+
+// getMidpoints' clustering of the columns with white bottle caps, fed one
+// column at a time. the last column of each cluster is only known to be the
+// last once the next one (or the end of the image) arrives, so each column is
+// held back by one
+struct MidpointFinder {
+	vector<int> midpoints;
+	int prev = 0, start = -1, pending = -1;
+	
+	void add(int x) {
+		if (pending >= 0)
+			process(pending, false);
+		pending = x;
+	}
+	void finish() {
+		if (pending >= 0)
+			process(pending, true);
+		pending = -1;
+	}
+	void process(int p, bool is_last) {
+		if (start == -1) {
+			start = p;
+		}
+		// assumes that no two bottlecaps will be closer than 10 pixels together
+		else if (p - prev > 10 || is_last) {
+			midpoints.push_back(((prev-start)/2)+start);
+			start = p;
+		}
+		prev = p;
+	}
+};
+
+/**
+ finds every bottle in an image and scores its label, as inspectBottles does,
+ but reading the image in strips of rows so that only one strip is ever in
+ memory. each pass reads the file from top to bottom once: the first for the
+ otsu threshold, the second over the top 20% to count the white pixels in
+ each column (which give the bottle cap midpoints) and the third over the
+ faces of the bottles to count their label pixels
+ 
+ @param filename the image, which must be a binary (P6) PPM
+ @param bounds output: the bounding box of each bottle in the image
+ @param ratios output: the white pixel ratio of each bottle in bounds
+ @param timer optional timer that each stage of the inspection is recorded to
+ @param strip_bytes the most image data read at a time
+ 
+ @return the bounding boxes of the bottles with no label
+ */
+vector<Rect> inspectBottlesInStrips(string filename, vector<Rect>& bounds,
+									vector<double>& ratios, Timestamper* timer = NULL,
+									int strip_bytes = STRIP_BYTES) {
+	TRACE_SCOPE("inspectBottlesInStrips");
+	bounds.clear();
+	ratios.clear();
+	StripReader reader;
+	if (!reader.open(filename))
+		return vector<Rect>();
+	int rows = reader.getRows(), cols = reader.getCols();
+	int strip_rows = reader.getStripRows(strip_bytes);
+	Mat strip;
+	
+	vector<int64> histogram(256, 0);
+	for (int y = 0; y < rows; y += strip_rows) {
+		int height = min(strip_rows, rows - y);
+		if (!reader.readStrip(y, height, strip))
+			return vector<Rect>();
+		const uchar* pixel = strip.data;
+		for (size_t i = 0; i < (size_t)height*cols; i++, pixel += 3)
+			histogram[grayLevel(pixel)]++;
+	}
+	int thresh = getOtsuThreshold(histogram);
+	
+	// getMidpoints averages the rows of the top of the binary image and
+	// rounds the average to 8 bits, so a column is white when
+	// 255*white/top_rows > 0.5
+	int top_rows = (int)(rows * 0.2);
+	vector<int> white(cols, 0);
+	for (int y = 0; y < top_rows; y += strip_rows) {
+		int height = min(strip_rows, top_rows - y);
+		if (!reader.readStrip(y, height, strip))
+			return vector<Rect>();
+		for (int row = 0; row < height; row++) {
+			const uchar* pixel = strip.ptr<uchar>(row);
+			for (int x = 0; x < cols; x++, pixel += 3)
+				if (grayLevel(pixel) > thresh)
+					white[x]++;
+		}
+	}
+	MidpointFinder finder;
+	for (int x = 0; x < cols && top_rows > 0; x++)
+		if (510*white[x] > top_rows)
+			finder.add(x);
+	finder.finish();
+	if (timer) timer->recordTime("Midpoints");
+	bounds = getBounds(Size(cols, rows), finder.midpoints);
+	if (timer) timer->recordTime("Bounds");
+	
+	// the face of each bottle is its bottom square. only the rows of the
+	// image which some face covers are read, and each row only counts
+	// towards the faces which cover it
+	static const vector<uchar> table = buildLabelTable();
+	vector<int64> counts(bounds.size(), 0);
+	vector<Rect> faces;
+	int first_row = rows, last_row = 0;
+	for (int j = 0; j < bounds.size(); j++) {
+		Rect face = Rect(bounds[j].x, bounds[j].y + bounds[j].height - bounds[j].width,
+						 bounds[j].width, bounds[j].width);
+		face &= Rect(0, 0, cols, rows);
+		faces.push_back(face);
+		if (face.area() > 0) {
+			first_row = min(first_row, face.y);
+			last_row = max(last_row, face.y + face.height);
+		}
+	}
+	for (int y = first_row; y < last_row; y += strip_rows) {
+		int height = min(strip_rows, last_row - y);
+		if (!reader.readStrip(y, height, strip))
+			return vector<Rect>();
+		for (int j = 0; j < faces.size(); j++) {
+			int top = max(faces[j].y, y);
+			int bottom = min(faces[j].y + faces[j].height, y + height);
+			for (int row = top; row < bottom; row++) {
+				const uchar* pixel = strip.ptr<uchar>(row - y) + faces[j].x*3;
+				for (int i = 0; i < faces[j].width; i++, pixel += 3) {
+					int maximum = max(max(pixel[0], pixel[1]), pixel[2]);
+					int minimum = min(min(pixel[0], pixel[1]), pixel[2]);
+					counts[j] += table[maximum*256 + minimum];
+				}
+			}
+		}
+	}
+	for (int j = 0; j < faces.size(); j++)
+		ratios.push_back((faces[j].area() > 0) ? ((double)counts[j]/(double)faces[j].area())*100 : 0);
+	if (timer) timer->recordTime("Ratios");
+	return getUnlabelledBottles(bounds, ratios);
+}
@@ -1,215 +1,378 @@
-/*
- * This code is provided as part of "A Practical Introduction to Computer Vision with OpenCV"
- * by Kenneth Dawson-Howe � Wiley & Sons Inc. 2014.  All rights reserved.
- */
-#include "Utilities.h"
-
-class Histogram
-{
-protected:
-	Mat mImage;
-	int mNumberChannels;
-	int* mChannelNumbers;
-	int* mNumberBins;
-	float mChannelRange[2];
-public:
-	Histogram( Mat image, int number_of_bins )
-	{
-		mImage = image;
-		mNumberChannels = mImage.channels();
-		mChannelNumbers = new int[mNumberChannels];
-		mNumberBins = new int[mNumberChannels];
-		mChannelRange[0] = 0.0;
-		mChannelRange[1] = 255.0;
-		for (int count=0; count<mNumberChannels; count++)
-		{
-			mChannelNumbers[count] = count;
-			mNumberBins[count] = number_of_bins;
-		}
-		//ComputeHistogram();
-	}
-	virtual void ComputeHistogram()=0;
-	virtual void NormaliseHistogram()=0;
-	static void Draw1DHistogram( MatND histograms[], int number_of_histograms, Mat& display_image )
-	{
-		int number_of_bins = histograms[0].size[0];
-		double max_value=0, min_value=0;
-		double channel_max_value=0, channel_min_value=0;
-		for (int channel=0; (channel < number_of_histograms); channel++)
-		{
-			minMaxLoc(histograms[channel], &channel_min_value, &channel_max_value, 0, 0);
-			max_value = ((max_value > channel_max_value) && (channel > 0)) ? max_value : channel_max_value;
-			min_value = ((min_value < channel_min_value) && (channel > 0)) ? min_value : channel_min_value;
-		}
-		float scaling_factor = ((float)256.0)/((float)number_of_bins);
-		
-		Mat histogram_image((int)(((float)number_of_bins)*scaling_factor)+1,(int)(((float)number_of_bins)*scaling_factor)+1,CV_8UC3,Scalar(255,255,255));
-		display_image = histogram_image;
-		line(histogram_image,Point(0,0),Point(0,histogram_image.rows-1),Scalar(0,0,0));
-		line(histogram_image,Point(histogram_image.cols-1,histogram_image.rows-1),Point(0,histogram_image.rows-1),Scalar(0,0,0));
-		int highest_point = static_cast<int>(0.9*((float)number_of_bins)*scaling_factor);
-		for (int channel=0; (channel < number_of_histograms); channel++)
-		{
-			int last_height;
-			for( int h = 0; h < number_of_bins; h++ )
-			{
-				float value = histograms[channel].at<float>(h);
-				int height = static_cast<int>(value*highest_point/max_value);
-				int where = (int)(((float)h)*scaling_factor);
-				if (h > 0)
-					line(histogram_image,Point((int)(((float)(h-1))*scaling_factor)+1,(int)(((float)number_of_bins)*scaling_factor)-last_height),
-								         Point((int)(((float)h)*scaling_factor)+1,(int)(((float)number_of_bins)*scaling_factor)-height),
-							             Scalar(channel==0?255:0,channel==1?255:0,channel==2?255:0));
-				last_height = height;
-			}
-		}
-	}
-};
-class OneDHistogram : public Histogram
-{
-private:
-	MatND mHistogram[3];
-public:
-	OneDHistogram( Mat image, int number_of_bins ) :
-	  Histogram( image, number_of_bins )
-	{
-		ComputeHistogram( );
-	}
-	void ComputeHistogram( )
-	{
-		vector<Mat> image_planes(mNumberChannels);
-		split(mImage, image_planes);
-		for (int channel=0; (channel < mNumberChannels); channel++)
-		{
-			const float* channel_ranges = mChannelRange;
-			int *mch = {0};
-			calcHist(&(image_planes[channel]), 1, mChannelNumbers, Mat(), mHistogram[channel], 1 , mNumberBins, &channel_ranges);
-		}
-	}
-	void SmoothHistogram( )
-	{
-		for (int channel=0; (channel < mNumberChannels); channel++)
-		{
-			MatND temp_histogram = mHistogram[channel].clone();
-			for(int i = 1; i < mHistogram[channel].rows - 1; ++i)
-			{
-				mHistogram[channel].at<float>(i) = (temp_histogram.at<float>(i-1) + temp_histogram.at<float>(i) + temp_histogram.at<float>(i+1)) / 3;
-			}
-		}
-	}
-	MatND getHistogram(int index)
-	{
-		return mHistogram[index];
-	}
-	void NormaliseHistogram()
-	{
-		for (int channel=0; (channel < mNumberChannels); channel++)
-		{
-			normalize(mHistogram[channel],mHistogram[channel],1.0);
-		}
-	}
-	Mat BackProject( Mat& image )
-	{
-		Mat result = image.clone();
-		if (mNumberChannels == 1)
-		{
-			const float* channel_ranges[] = { mChannelRange, mChannelRange, mChannelRange };
-			for (int channel=0; (channel < mNumberChannels); channel++)
-			{
-				calcBackProject(&image,1,mChannelNumbers,*mHistogram,result,channel_ranges,255.0);
-			}
-		}
-		else
-		{
-		}
-		return result;
-	}
-	void Draw( Mat& display_image )
-	{
-		Draw1DHistogram( mHistogram, mNumberChannels, display_image );
-	}
-};
-
-
-class ColourHistogram : public Histogram
-{
-private:
-	MatND mHistogram;
-public:
-	ColourHistogram( Mat image, int number_of_bins ) :
-	  Histogram( image, number_of_bins )
-	{
-		ComputeHistogram();
-	}
-	void ComputeHistogram()
-	{
-		const float* channel_ranges[] = { mChannelRange, mChannelRange, mChannelRange };
-		calcHist(&mImage, 1, mChannelNumbers, Mat(), mHistogram, mNumberChannels, mNumberBins, channel_ranges);
-	}
-	void NormaliseHistogram()
-	{
-		normalize(mHistogram,mHistogram,1.0);
-	}
-	Mat BackProject( Mat& image )
-	{
-		Mat result = image.clone();
-		const float* channel_ranges[] = { mChannelRange, mChannelRange, mChannelRange };
-		calcBackProject(&image,1,mChannelNumbers,mHistogram,result,channel_ranges,255.0);
-		return result;
-	}
-	MatND getHistogram()
-	{
-		return mHistogram;
-	}
-};
-
-
-class HueHistogram : public Histogram
-{
-private:
-	MatND mHistogram;
-	int mMinimumSaturation, mMinimumValue, mMaximumValue;
-#define DEFAULT_MIN_SATURATION 25
-#define DEFAULT_MIN_VALUE 25
-#define DEFAULT_MAX_VALUE 230
-public:
-	HueHistogram( Mat image, int number_of_bins, int min_saturation=DEFAULT_MIN_SATURATION, int min_value=DEFAULT_MIN_VALUE, int max_value=DEFAULT_MAX_VALUE ) :
-	  Histogram( image, number_of_bins )
-	{
-		mMinimumSaturation = min_saturation;
-		mMinimumValue = min_value;
-		mMaximumValue = max_value;
-		mChannelRange[1] = 180.0;
-		ComputeHistogram();
-	}
-	void ComputeHistogram()
-	{
-		Mat hsv_image, hue_image, mask_image;
-		cvtColor(mImage, hsv_image, CV_BGR2HSV);
-		inRange( hsv_image, Scalar( 0, mMinimumSaturation, mMinimumValue ), Scalar( 180, 256, mMaximumValue ), mask_image );
-		int channels[]={0,0};
-		hue_image.create( mImage.size(), mImage.depth());
-		mixChannels( &hsv_image, 1, &hue_image, 1, channels, 1 );
-		const float* channel_ranges = mChannelRange;
-		calcHist( &hue_image,1,0,mask_image,mHistogram,1,mNumberBins,&channel_ranges);
-	}
-	void NormaliseHistogram()
-	{
-		normalize(mHistogram,mHistogram,0,255,CV_MINMAX);
-	}
-	Mat BackProject( Mat& image )
-	{
-		Mat result = image.clone();
-		const float* channel_ranges = mChannelRange;
-		calcBackProject(&image,1,mChannelNumbers,mHistogram,result,&channel_ranges,255.0);
-		return result;
-	}
-	MatND getHistogram()
-	{
-		return mHistogram;
-	}
-	void Draw( Mat& display_image )
-	{
-		Draw1DHistogram( &mHistogram, 1, display_image );
-	}
-};
+/*
+ * This code is provided as part of "A Practical Introduction to Computer Vision with OpenCV"
+ * by Kenneth Dawson-Howe � Wiley & Sons Inc. 2014.  All rights reserved.
+ */
+#include "../CV Common/Utilities.h"
+#include <string.h>
+#if CV_SSE2
+#include <emmintrin.h>
+#endif
+
+class Histogram
+{
+protected:
+	Mat mImage;
+	int mNumberChannels;
+	int* mChannelNumbers;
+	int* mNumberBins;
+	float mChannelRange[2];
+public:
+	Histogram( Mat image, int number_of_bins )
+	{
+		mImage = image;
+		mNumberChannels = mImage.channels();
+		mChannelNumbers = new int[mNumberChannels];
+		mNumberBins = new int[mNumberChannels];
+		mChannelRange[0] = 0.0;
+		mChannelRange[1] = 255.0;
+		for (int count=0; count<mNumberChannels; count++)
+		{
+			mChannelNumbers[count] = count;
+			mNumberBins[count] = number_of_bins;
+		}
+		//ComputeHistogram();
+	}
+	virtual void ComputeHistogram()=0;
+	virtual void NormaliseHistogram()=0;
+	static void Draw1DHistogram( MatND histograms[], int number_of_histograms, Mat& display_image )
+	{
+		int number_of_bins = histograms[0].size[0];
+		double max_value=0, min_value=0;
+		double channel_max_value=0, channel_min_value=0;
+		for (int channel=0; (channel < number_of_histograms); channel++)
+		{
+			minMaxLoc(histograms[channel], &channel_min_value, &channel_max_value, 0, 0);
+			max_value = ((max_value > channel_max_value) && (channel > 0)) ? max_value : channel_max_value;
+			min_value = ((min_value < channel_min_value) && (channel > 0)) ? min_value : channel_min_value;
+		}
+		float scaling_factor = ((float)256.0)/((float)number_of_bins);
+		
+		Mat histogram_image((int)(((float)number_of_bins)*scaling_factor)+1,(int)(((float)number_of_bins)*scaling_factor)+1,CV_8UC3,Scalar(255,255,255));
+		display_image = histogram_image;
+		line(histogram_image,Point(0,0),Point(0,histogram_image.rows-1),Scalar(0,0,0));
+		line(histogram_image,Point(histogram_image.cols-1,histogram_image.rows-1),Point(0,histogram_image.rows-1),Scalar(0,0,0));
+		int highest_point = static_cast<int>(0.9*((float)number_of_bins)*scaling_factor);
+		for (int channel=0; (channel < number_of_histograms); channel++)
+		{
+			int last_height;
+			for( int h = 0; h < number_of_bins; h++ )
+			{
+				float value = histograms[channel].at<float>(h);
+				int height = static_cast<int>(value*highest_point/max_value);
+				int where = (int)(((float)h)*scaling_factor);
+				if (h > 0)
+					line(histogram_image,Point((int)(((float)(h-1))*scaling_factor)+1,(int)(((float)number_of_bins)*scaling_factor)-last_height),
+								         Point((int)(((float)h)*scaling_factor)+1,(int)(((float)number_of_bins)*scaling_factor)-height),
+							             Scalar(channel==0?255:0,channel==1?255:0,channel==2?255:0));
+				last_height = height;
+			}
+		}
+	}
+};
+#define BACK_PROJECT_PRODUCT 0
+#define BACK_PROJECT_MINIMUM 1
+class OneDHistogram : public Histogram
+{
+private:
+	MatND mHistogram[3];
+public:
+	OneDHistogram( Mat image, int number_of_bins ) :
+	  Histogram( image, number_of_bins )
+	{
+		ComputeHistogram( );
+	}
+	void ComputeHistogram( )
+	{
+		vector<Mat> image_planes(mNumberChannels);
+		split(mImage, image_planes);
+		for (int channel=0; (channel < mNumberChannels); channel++)
+		{
+			const float* channel_ranges = mChannelRange;
+			int *mch = {0};
+			calcHist(&(image_planes[channel]), 1, mChannelNumbers, Mat(), mHistogram[channel], 1 , mNumberBins, &channel_ranges);
+		}
+	}
+	void SmoothHistogram( )
+	{
+		for (int channel=0; (channel < mNumberChannels); channel++)
+		{
+			MatND temp_histogram = mHistogram[channel].clone();
+			for(int i = 1; i < mHistogram[channel].rows - 1; ++i)
+			{
+				mHistogram[channel].at<float>(i) = (temp_histogram.at<float>(i-1) + temp_histogram.at<float>(i) + temp_histogram.at<float>(i+1)) / 3;
+			}
+		}
+	}
+	MatND getHistogram(int index)
+	{
+		return mHistogram[index];
+	}
+	void NormaliseHistogram()
+	{
+		for (int channel=0; (channel < mNumberChannels); channel++)
+		{
+			normalize(mHistogram[channel],mHistogram[channel],1.0);
+		}
+	}
+	Mat BackProject( Mat& image )
+	{
+		// both calcBackProject and the overload below allocate the result
+		Mat result;
+		if (mNumberChannels == 1)
+		{
+			const float* channel_ranges[] = { mChannelRange, mChannelRange, mChannelRange };
+			for (int channel=0; (channel < mNumberChannels); channel++)
+			{
+				calcBackProject(&image,1,mChannelNumbers,*mHistogram,result,channel_ranges,255.0);
+			}
+		}
+		else
+		{
+			BackProject( image, result, BACK_PROJECT_PRODUCT );
+		}
+		return result;
+	}
+	// Back projects each channel through its own histogram (as calcBackProject
+	// would, scaled by 255) and combines the channels' values, either as the
+	// product of their probabilities or as the minimum of them.  The result is
+	// written into the caller's buffer, which is only reallocated if it isn't
+	// already a single channel 8 bit image of the right size.
+	void BackProject( Mat& image, Mat& result, int combination=BACK_PROJECT_PRODUCT )
+	{
+		CV_Assert((image.depth() == CV_8U) && (image.channels() == mNumberChannels));
+		CV_Assert((combination == BACK_PROJECT_PRODUCT) || (combination == BACK_PROJECT_MINIMUM));
+		result.create(image.size(), CV_8UC1);
+		// the back projected value of each possible value of each channel
+		uchar tables[3][256];
+		for (int channel=0; (channel < mNumberChannels); channel++)
+		{
+			double bins_per_value = mNumberBins[channel]/(mChannelRange[1]-mChannelRange[0]);
+			for (int value=0; value < 256; value++)
+			{
+				int bin = cvFloor((value-mChannelRange[0])*bins_per_value);
+				tables[channel][value] = ((bin >= 0) && (bin < mNumberBins[channel])) ?
+					saturate_cast<uchar>(mHistogram[channel].at<float>(bin)*255.0) : 0;
+			}
+		}
+		// each row is looked up a channel at a time into the row buffers, and
+		// the buffers are then combined 16 values at a time
+		vector<uchar> row_buffers(mNumberChannels*image.cols);
+		for (int row=0; row < image.rows; row++)
+		{
+			const uchar* pixel = image.ptr<uchar>(row);
+			for (int column=0; column < image.cols; column++)
+				for (int channel=0; (channel < mNumberChannels); channel++, pixel++)
+					row_buffers[channel*image.cols + column] = tables[channel][*pixel];
+			uchar* output = result.ptr<uchar>(row);
+			memcpy(output, &row_buffers[0], image.cols);
+			for (int channel=1; (channel < mNumberChannels); channel++)
+				CombineBackProjections(output, &row_buffers[channel*image.cols], image.cols, combination);
+		}
+	}
+	// output = output*values/255 (rounded) or min(output, values)
+	static void CombineBackProjections( uchar* output, const uchar* values, int number_of_values, int combination )
+	{
+		int value = 0;
+#if CV_SSE2
+		const __m128i zero = _mm_setzero_si128(), rounding = _mm_set1_epi16(128);
+		for (; value <= number_of_values-16; value += 16)
+		{
+			__m128i current = _mm_loadu_si128((const __m128i*) (output+value));
+			__m128i next = _mm_loadu_si128((const __m128i*) (values+value));
+			if (combination == BACK_PROJECT_MINIMUM)
+				current = _mm_min_epu8(current, next);
+			else
+			{
+				// x/255 rounded is (x + 128 + ((x + 128) >> 8)) >> 8 for x <= 255*255
+				__m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(current, zero), _mm_unpacklo_epi8(next, zero)), rounding);
+				__m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(current, zero), _mm_unpackhi_epi8(next, zero)), rounding);
+				low = _mm_srli_epi16(_mm_add_epi16(low, _mm_srli_epi16(low, 8)), 8);
+				high = _mm_srli_epi16(_mm_add_epi16(high, _mm_srli_epi16(high, 8)), 8);
+				current = _mm_packus_epi16(low, high);
+			}
+			_mm_storeu_si128((__m128i*) (output+value), current);
+		}
+#endif
+		for (; value < number_of_values; value++)
+		{
+			if (combination == BACK_PROJECT_MINIMUM)
+				output[value] = std::min(output[value], values[value]);
+			else
+			{
+				int product = output[value]*values[value] + 128;
+				output[value] = (uchar) ((product + (product >> 8)) >> 8);
+			}
+		}
+	}
+	void Draw( Mat& display_image )
+	{
+		Draw1DHistogram( mHistogram, mNumberChannels, display_image );
+	}
+};
+
+
+class ColourHistogram : public Histogram
+{
+private:
+	MatND mHistogram;
+public:
+	ColourHistogram( Mat image, int number_of_bins ) :
+	  Histogram( image, number_of_bins )
+	{
+		ComputeHistogram();
+	}
+	void ComputeHistogram()
+	{
+		const float* channel_ranges[] = { mChannelRange, mChannelRange, mChannelRange };
+		calcHist(&mImage, 1, mChannelNumbers, Mat(), mHistogram, mNumberChannels, mNumberBins, channel_ranges);
+	}
+	void NormaliseHistogram()
+	{
+		normalize(mHistogram,mHistogram,1.0);
+	}
+	Mat BackProject( Mat& image )
+	{
+		Mat result = image.clone();
+		const float* channel_ranges[] = { mChannelRange, mChannelRange, mChannelRange };
+		calcBackProject(&image,1,mChannelNumbers,mHistogram,result,channel_ranges,255.0);
+		return result;
+	}
+	MatND getHistogram()
+	{
+		return mHistogram;
+	}
+};
+
+
+// Converts BGR pixels to 8 bit HSV exactly as cvtColor does (in fixed point
+// with the same division tables), gates them on saturation and value as
+// inRange does, and counts the hue of those that pass, all in one pass.  Each
+// band of rows counts into its own partial histograms (four of them, used in
+// turn, so that runs of the same hue don't wait on each other's increments)
+// which are merged into the total at the end of the band.
+#define HSV_SHIFT 12
+#define HUE_SUB_HISTOGRAMS 4
+struct HSVDivisors {
+	int mSaturation[256];
+	int mHue[256];
+	HSVDivisors()
+	{
+		mSaturation[0] = mHue[0] = 0;
+		for (int i=1; i < 256; i++)
+		{
+			mSaturation[i] = saturate_cast<int>((255 << HSV_SHIFT)/(1.*i));
+			mHue[i] = saturate_cast<int>((180 << HSV_SHIFT)/(6.*i));
+		}
+	}
+};
+class HueHistogramBody : public ParallelLoopBody
+{
+private:
+	const Mat& mImage;
+	const int* mBinOfHue;
+	int mNumberBins;
+	int mMinimumSaturation, mMinimumValue, mMaximumValue;
+	vector<int>& mTotals;
+	mutable std::mutex mLock;
+public:
+	HueHistogramBody( const Mat& image, const int* bin_of_hue, int number_of_bins, int min_saturation, int min_value, int max_value, vector<int>& totals ) :
+		mImage(image), mBinOfHue(bin_of_hue), mNumberBins(number_of_bins), mMinimumSaturation(min_saturation),
+		mMinimumValue(min_value), mMaximumValue(max_value), mTotals(totals)
+	{
+	}
+	void operator()( const Range& rows ) const
+	{
+		static const HSVDivisors divisors;
+		const int* saturation_divisors = divisors.mSaturation;
+		const int* hue_divisors = divisors.mHue;
+		vector<int> partial(HUE_SUB_HISTOGRAMS*mNumberBins, 0);
+		int sub_histogram = 0;
+		for (int row=rows.start; row < rows.end; row++)
+		{
+			const uchar* pixel = mImage.ptr<uchar>(row);
+			for (int column=0; column < mImage.cols; column++, pixel += 3)
+			{
+				int b = pixel[0], g = pixel[1], r = pixel[2];
+				int v = std::max(std::max(b, g), r);
+				if ((v < mMinimumValue) || (v > mMaximumValue))
+					continue;
+				int diff = v - std::min(std::min(b, g), r);
+				int s = (diff*saturation_divisors[v] + (1 << (HSV_SHIFT-1))) >> HSV_SHIFT;
+				if (s < mMinimumSaturation)
+					continue;
+				int h = (v == r) ? (g - b) : ((v == g) ? (b - r + 2*diff) : (r - g + 4*diff));
+				h = (h*hue_divisors[diff] + (1 << (HSV_SHIFT-1))) >> HSV_SHIFT;
+				h += (h < 0) ? 180 : 0;
+				int bin = mBinOfHue[h];
+				if (bin >= 0)
+					partial[sub_histogram*mNumberBins + bin]++;
+				sub_histogram = (sub_histogram+1) % HUE_SUB_HISTOGRAMS;
+			}
+		}
+		std::lock_guard<std::mutex> lock(mLock);
+		for (int bin=0; bin < mNumberBins; bin++)
+			for (int sub=0; sub < HUE_SUB_HISTOGRAMS; sub++)
+				mTotals[bin] += partial[sub*mNumberBins + bin];
+	}
+};
+
+class HueHistogram : public Histogram
+{
+private:
+	MatND mHistogram;
+	int mMinimumSaturation, mMinimumValue, mMaximumValue;
+#define DEFAULT_MIN_SATURATION 25
+#define DEFAULT_MIN_VALUE 25
+#define DEFAULT_MAX_VALUE 230
+public:
+	HueHistogram( Mat image, int number_of_bins, int min_saturation=DEFAULT_MIN_SATURATION, int min_value=DEFAULT_MIN_VALUE, int max_value=DEFAULT_MAX_VALUE ) :
+	  Histogram( image, number_of_bins )
+	{
+		mMinimumSaturation = min_saturation;
+		mMinimumValue = min_value;
+		mMaximumValue = max_value;
+		mChannelRange[1] = 180.0;
+		ComputeHistogram();
+	}
+	void ComputeHistogram()
+	{
+		CV_Assert(mImage.type() == CV_8UC3);
+		// the bin of each possible hue, as calcHist maps 8 bit values onto
+		// the bins (hues outside the range are not counted)
+		int number_of_bins = mNumberBins[0];
+		int bin_of_hue[256];
+		double bins_per_hue = number_of_bins/(mChannelRange[1]-mChannelRange[0]);
+		for (int hue=0; hue < 256; hue++)
+		{
+			int bin = cvFloor((hue-mChannelRange[0])*bins_per_hue);
+			bin_of_hue[hue] = ((bin >= 0) && (bin < number_of_bins)) ? bin : -1;
+		}
+		vector<int> totals(number_of_bins, 0);
+		HueHistogramBody body(mImage, bin_of_hue, number_of_bins, mMinimumSaturation, mMinimumValue, mMaximumValue, totals);
+		if (mImage.total() < 256*1024)
+			body(Range(0, mImage.rows));
+		else parallel_for_(Range(0, mImage.rows), body);
+		mHistogram.create(number_of_bins, 1, CV_32F);
+		for (int bin=0; bin < number_of_bins; bin++)
+			mHistogram.at<float>(bin) = (float) totals[bin];
+	}
+	void NormaliseHistogram()
+	{
+		normalize(mHistogram,mHistogram,0,255,CV_MINMAX);
+	}
+	Mat BackProject( Mat& image )
+	{
+		Mat result = image.clone();
+		const float* channel_ranges = mChannelRange;
+		calcBackProject(&image,1,mChannelNumbers,mHistogram,result,&channel_ranges,255.0);
+		return result;
+	}
+	MatND getHistogram()
+	{
+		return mHistogram;
+	}
+	void Draw( Mat& display_image )
+	{
+		Draw1DHistogram( &mHistogram, 1, display_image );
+	}
+};
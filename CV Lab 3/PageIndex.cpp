@@ -0,0 +1,442 @@
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/features2d.hpp>
+#include <opencv2/calib3d.hpp>
+
+#include <iostream>
+#include <algorithm>
+#include <climits>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../CV Common/Utilities.h"
+
+#if CV_SSSE3
+#include <tmmintrin.h>
+#endif
+
+using namespace cv;
+using namespace std;
+
+// ORB descriptors are 256 bits
+#define INDEX_DESCRIPTOR_BYTES	32
+#define INDEX_FEATURES			500
+// the vocabulary tree has up to BRANCHING^DEPTH words
+#define INDEX_BRANCHING			10
+#define INDEX_DEPTH				4
+#define INDEX_ITERATIONS		5
+// how many of the best voted pages are checked geometrically
+#define INDEX_VERIFY			5
+#define INDEX_RATIO				0.8
+#define INDEX_RANSAC_THRESHOLD	5.0
+#define INDEX_MIN_INLIERS		12
+// words in more than this fraction of the pages (and at least
+// INDEX_MIN_STOP_PAGES of them) say little about the page, and are skipped
+// when voting so that the cost of a query doesn't grow with the catalogue
+#define INDEX_STOP_FRACTION		0.05
+#define INDEX_MIN_STOP_PAGES	32
+
+/**
+ * Hamming distance between two ORB descriptors, counting the bits of the xor
+ * 16 bytes at a time with a nibble lookup table where SSSE3 is available.
+ * @param a first descriptor (INDEX_DESCRIPTOR_BYTES bytes)
+ * @param b second descriptor
+ * @return number of differing bits
+ */
+static inline int hammingDistance(const uchar* a, const uchar* b) {
+#if CV_SSSE3
+	const __m128i lookup = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m128i low_nibbles = _mm_set1_epi8(0x0f);
+	__m128i x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)a), _mm_loadu_si128((const __m128i*)b));
+	__m128i x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a+16)), _mm_loadu_si128((const __m128i*)(b+16)));
+	__m128i counts = _mm_add_epi8(
+		_mm_add_epi8(_mm_shuffle_epi8(lookup, _mm_and_si128(x0, low_nibbles)),
+					 _mm_shuffle_epi8(lookup, _mm_and_si128(_mm_srli_epi16(x0, 4), low_nibbles))),
+		_mm_add_epi8(_mm_shuffle_epi8(lookup, _mm_and_si128(x1, low_nibbles)),
+					 _mm_shuffle_epi8(lookup, _mm_and_si128(_mm_srli_epi16(x1, 4), low_nibbles))));
+	// each byte count is at most 16, so the sums of the two halves are exact
+	__m128i sums = _mm_sad_epu8(counts, _mm_setzero_si128());
+	return _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+#else
+	uint64 wa[INDEX_DESCRIPTOR_BYTES/8], wb[INDEX_DESCRIPTOR_BYTES/8];
+	memcpy(wa, a, INDEX_DESCRIPTOR_BYTES);
+	memcpy(wb, b, INDEX_DESCRIPTOR_BYTES);
+	int distance = 0;
+	for (int i = 0; i < INDEX_DESCRIPTOR_BYTES/8; i++)
+		distance += __builtin_popcountll(wa[i] ^ wb[i]);
+	return distance;
+#endif
+}
+
+// one of the best voted pages for a query
+struct PageCandidate {
+	int page;
+	float score;
+	int inliers;
+};
+
+// retrieves pages by their local features rather than by correlating whole
+// rectified images. ORB descriptors are quantised to the words of a
+// vocabulary tree, each word has an inverted list of the pages it appears in,
+// and queries are scored by tf-idf voting over the lists of their words. only
+// the best few pages are then verified with a RANSAC homography, so the cost of
+// a query depends on the vocabulary and the verification rather than the
+// number of pages
+class PageIndex {
+public:
+	PageIndex(int branching = INDEX_BRANCHING, int depth = INDEX_DEPTH);
+	void train(vector<Mat>& images);
+	int addPage(Mat img);
+	int query(Mat img, vector<PageCandidate>* candidates = NULL);
+	int getNumberOfPages() {
+		return (int) pages.size();
+	}
+	int getNumberOfWords() {
+		return number_of_words;
+	}
+	String getString();
+
+private:
+	struct Node {
+		uchar centre[INDEX_DESCRIPTOR_BYTES];
+		int first_child;
+		int children;
+		int word;
+	};
+	struct Posting {
+		int page;
+		float count;
+	};
+	struct Page {
+		vector<Point2f> points;
+		Mat descriptors;
+	};
+	void extractFeatures(Mat img, vector<Point2f>& points, Mat& descriptors);
+	void buildNode(int node, Mat& descriptors, vector<int>& members, int level);
+	int quantise(const uchar* descriptor);
+	void updatePageNorms();
+	int verify(vector<Point2f>& points, Mat& descriptors, Page& page);
+
+	int branching;
+	int depth;
+	Ptr<ORB> detector;
+	RNG rng;
+	vector<Node> tree;
+	int number_of_words;
+	vector<vector<Posting> > postings;
+	vector<Page> pages;
+	vector<float> page_norms;
+	bool norms_dirty;
+	// scratch space for voting, reset only where a query touched it
+	vector<float> scores;
+	vector<int> touched;
+	int queries;
+	int verified;
+};
+
+PageIndex::PageIndex(int branching, int depth) : rng(0x12345678) {
+	this->branching = branching;
+	this->depth = depth;
+	detector = ORB::create(INDEX_FEATURES);
+	number_of_words = 0;
+	norms_dirty = false;
+	queries = 0;
+	verified = 0;
+}
+
+void PageIndex::extractFeatures(Mat img, vector<Point2f>& points, Mat& descriptors) {
+	TRACE_SCOPE("PageIndex::extractFeatures");
+	Mat gray = img;
+	if (img.channels() == 3)
+		cvtColor(img, gray, CV_BGR2GRAY);
+	vector<KeyPoint> keypoints;
+	detector->detectAndCompute(gray, Mat(), keypoints, descriptors);
+	points.clear();
+	for (int i = 0; i < keypoints.size(); i++)
+		points.push_back(keypoints[i].pt);
+	if (!descriptors.empty())
+		CV_Assert(descriptors.type() == CV_8UC1 && descriptors.cols == INDEX_DESCRIPTOR_BYTES);
+}
+
+// build the vocabulary from the features of some sample images, which would
+// normally be (a sample of) the pages that are going to be added. any pages
+// already in the index are removed
+void PageIndex::train(vector<Mat>& images) {
+	TRACE_SCOPE("PageIndex::train");
+	Mat descriptors;
+	for (int i = 0; i < images.size(); i++) {
+		vector<Point2f> points;
+		Mat image_descriptors;
+		extractFeatures(images[i], points, image_descriptors);
+		descriptors.push_back(image_descriptors);
+	}
+	tree.assign(1, Node());
+	memset(tree[0].centre, 0, INDEX_DESCRIPTOR_BYTES);
+	number_of_words = 0;
+	vector<int> members;
+	for (int i = 0; i < descriptors.rows; i++)
+		members.push_back(i);
+	buildNode(0, descriptors, members, 0);
+	postings.assign(number_of_words, vector<Posting>());
+	pages.clear();
+	page_norms.clear();
+	scores.clear();
+	touched.clear();
+}
+
+// split the descriptors of a node by k-majority clustering (k-means with the
+// hamming distance, where each centre is the bitwise majority of its members)
+// and build the children. a node is a word if it is at the bottom of the tree
+// or has too few descriptors to split
+void PageIndex::buildNode(int node, Mat& descriptors, vector<int>& members, int level) {
+	tree[node].first_child = -1;
+	tree[node].children = 0;
+	tree[node].word = -1;
+	if (level == depth || members.size() <= branching) {
+		tree[node].word = number_of_words++;
+		return;
+	}
+
+	// start from distinct random members
+	vector<int> shuffled = members;
+	for (int i = (int) shuffled.size()-1; i > 0; i--)
+		swap(shuffled[i], shuffled[rng.uniform(0, i+1)]);
+	vector<vector<uchar> > centres(branching, vector<uchar>(INDEX_DESCRIPTOR_BYTES));
+	for (int c = 0; c < branching; c++)
+		memcpy(&centres[c][0], descriptors.ptr<uchar>(shuffled[c]), INDEX_DESCRIPTOR_BYTES);
+
+	vector<int> assignment(members.size(), 0);
+	vector<int> bit_counts(branching*INDEX_DESCRIPTOR_BYTES*8);
+	vector<int> cluster_sizes(branching);
+	for (int iteration = 0; iteration < INDEX_ITERATIONS; iteration++) {
+		bool changed = false;
+		for (int m = 0; m < members.size(); m++) {
+			const uchar* descriptor = descriptors.ptr<uchar>(members[m]);
+			int best = 0, best_distance = INT_MAX;
+			for (int c = 0; c < branching; c++) {
+				int distance = hammingDistance(descriptor, &centres[c][0]);
+				if (distance < best_distance) {
+					best_distance = distance;
+					best = c;
+				}
+			}
+			if (iteration == 0 || assignment[m] != best)
+				changed = true;
+			assignment[m] = best;
+		}
+		// the children are built from the final assignment
+		if (!changed || iteration == INDEX_ITERATIONS-1)
+			break;
+		fill(bit_counts.begin(), bit_counts.end(), 0);
+		fill(cluster_sizes.begin(), cluster_sizes.end(), 0);
+		for (int m = 0; m < members.size(); m++) {
+			const uchar* descriptor = descriptors.ptr<uchar>(members[m]);
+			int* counts = &bit_counts[assignment[m]*INDEX_DESCRIPTOR_BYTES*8];
+			for (int bit = 0; bit < INDEX_DESCRIPTOR_BYTES*8; bit++)
+				counts[bit] += (descriptor[bit >> 3] >> (bit & 7)) & 1;
+			cluster_sizes[assignment[m]]++;
+		}
+		for (int c = 0; c < branching; c++) {
+			// an empty cluster keeps its old centre
+			if (cluster_sizes[c] == 0)
+				continue;
+			const int* counts = &bit_counts[c*INDEX_DESCRIPTOR_BYTES*8];
+			memset(&centres[c][0], 0, INDEX_DESCRIPTOR_BYTES);
+			for (int bit = 0; bit < INDEX_DESCRIPTOR_BYTES*8; bit++)
+				if (2*counts[bit] > cluster_sizes[c])
+					centres[c][bit >> 3] |= 1 << (bit & 7);
+		}
+	}
+
+	int first_child = (int) tree.size();
+	tree[node].first_child = first_child;
+	tree[node].children = branching;
+	tree.resize(tree.size()+branching);
+	for (int c = 0; c < branching; c++) {
+		memcpy(tree[first_child+c].centre, &centres[c][0], INDEX_DESCRIPTOR_BYTES);
+		vector<int> child_members;
+		for (int m = 0; m < members.size(); m++)
+			if (assignment[m] == c)
+				child_members.push_back(members[m]);
+		buildNode(first_child+c, descriptors, child_members, level+1);
+	}
+}
+
+// descend the tree to the word of a descriptor
+int PageIndex::quantise(const uchar* descriptor) {
+	int node = 0;
+	while (tree[node].word < 0) {
+		int best = tree[node].first_child, best_distance = INT_MAX;
+		for (int c = tree[node].first_child; c < tree[node].first_child+tree[node].children; c++) {
+			int distance = hammingDistance(descriptor, tree[c].centre);
+			if (distance < best_distance) {
+				best_distance = distance;
+				best = c;
+			}
+		}
+		node = best;
+	}
+	return tree[node].word;
+}
+
+// add a page to the index, returning its page number. the index must have
+// been trained
+int PageIndex::addPage(Mat img) {
+	TRACE_SCOPE("PageIndex::addPage");
+	CV_Assert(!tree.empty());
+	Page page;
+	extractFeatures(img, page.points, page.descriptors);
+	int page_number = (int) pages.size();
+	for (int i = 0; i < page.descriptors.rows; i++) {
+		vector<Posting>& list = postings[quantise(page.descriptors.ptr<uchar>(i))];
+		// pages are added in order, so a page's posting is always the last
+		if (!list.empty() && list.back().page == page_number) {
+			list.back().count++;
+		} else {
+			Posting posting = { page_number, 1 };
+			list.push_back(posting);
+		}
+	}
+	pages.push_back(page);
+	scores.push_back(0);
+	norms_dirty = true;
+	return page_number;
+}
+
+// the norms of the pages' tf-idf vectors change with the idf of every word, so
+// they are recomputed before the first query after pages are added
+void PageIndex::updatePageNorms() {
+	page_norms.assign(pages.size(), 0);
+	for (int w = 0; w < postings.size(); w++) {
+		if (postings[w].empty())
+			continue;
+		float idf = log((float) pages.size()/postings[w].size());
+		for (int p = 0; p < postings[w].size(); p++) {
+			float weight = postings[w][p].count*idf;
+			page_norms[postings[w][p].page] += weight*weight;
+		}
+	}
+	for (int p = 0; p < page_norms.size(); p++)
+		page_norms[p] = sqrt(page_norms[p]);
+	norms_dirty = false;
+}
+
+// count the query features whose best match in the page passes the ratio
+// test and agrees with a homography of the page into the query
+int PageIndex::verify(vector<Point2f>& points, Mat& descriptors, Page& page) {
+	TRACE_SCOPE("PageIndex::verify");
+	vector<Point2f> page_points, query_points;
+	for (int q = 0; q < descriptors.rows; q++) {
+		const uchar* descriptor = descriptors.ptr<uchar>(q);
+		int best = -1, best_distance = INT_MAX, second_distance = INT_MAX;
+		for (int d = 0; d < page.descriptors.rows; d++) {
+			int distance = hammingDistance(descriptor, page.descriptors.ptr<uchar>(d));
+			if (distance < best_distance) {
+				second_distance = best_distance;
+				best_distance = distance;
+				best = d;
+			} else if (distance < second_distance) {
+				second_distance = distance;
+			}
+		}
+		if (best >= 0 && best_distance < INDEX_RATIO*second_distance) {
+			page_points.push_back(page.points[best]);
+			query_points.push_back(points[q]);
+		}
+	}
+	if (page_points.size() < 4)
+		return 0;
+	Mat inlier_mask;
+	Mat homography = findHomography(page_points, query_points, RANSAC, INDEX_RANSAC_THRESHOLD, inlier_mask);
+	if (homography.empty())
+		return 0;
+	return countNonZero(inlier_mask);
+}
+
+/**
+ * Find the page shown in an image.
+ * @param img the query image (grey or BGR), which need not be rectified
+ * @param candidates if not NULL, set to the verified candidates, best first
+ * @return the index of the best page, or -1 if the index is empty or the
+ * image has no features
+ */
+int PageIndex::query(Mat img, vector<PageCandidate>* candidates) {
+	TRACE_SCOPE("PageIndex::query");
+	CV_Assert(!tree.empty());
+	if (candidates) candidates->clear();
+	if (pages.empty())
+		return -1;
+	if (norms_dirty)
+		updatePageNorms();
+	queries++;
+
+	vector<Point2f> points;
+	Mat descriptors;
+	extractFeatures(img, points, descriptors);
+	if (descriptors.empty())
+		return -1;
+
+	// the query's word counts, in word order
+	vector<int> words(descriptors.rows);
+	for (int i = 0; i < descriptors.rows; i++)
+		words[i] = quantise(descriptors.ptr<uchar>(i));
+	sort(words.begin(), words.end());
+
+	// vote with the cosine of the tf-idf vectors, leaving out the query's
+	// norm which is the same for every page
+	int stop_pages = max(INDEX_MIN_STOP_PAGES, (int) (INDEX_STOP_FRACTION*pages.size()));
+	touched.clear();
+	for (int i = 0; i < words.size(); ) {
+		int word = words[i], count = 0;
+		for (; i < words.size() && words[i] == word; i++)
+			count++;
+		vector<Posting>& list = postings[word];
+		if (list.empty() || list.size() > stop_pages)
+			continue;
+		float idf = log((float) pages.size()/list.size());
+		// a word in every page can't tell them apart
+		if (idf <= 0)
+			continue;
+		float query_weight = count*idf*idf;
+		for (int p = 0; p < list.size(); p++) {
+			if (scores[list[p].page] == 0)
+				touched.push_back(list[p].page);
+			scores[list[p].page] += query_weight*list[p].count;
+		}
+	}
+	vector<PageCandidate> best;
+	for (int t = 0; t < touched.size(); t++) {
+		int page = touched[t];
+		PageCandidate candidate = { page, (page_norms[page] > 0) ? scores[page]/page_norms[page] : 0, 0 };
+		best.push_back(candidate);
+		scores[page] = 0;
+	}
+	if (best.empty())
+		return -1;
+	int number_to_verify = min((int) best.size(), INDEX_VERIFY);
+	partial_sort(best.begin(), best.begin()+number_to_verify, best.end(),
+				 [](const PageCandidate& a, const PageCandidate& b) { return a.score > b.score; });
+	best.resize(number_to_verify);
+
+	// the votes only choose which pages are worth verifying. if none of them
+	// is verified the best voted page is returned
+	for (int c = 0; c < best.size(); c++) {
+		best[c].inliers = verify(points, descriptors, pages[best[c].page]);
+		verified++;
+	}
+	stable_sort(best.begin(), best.end(),
+				[](const PageCandidate& a, const PageCandidate& b) { return a.inliers > b.inliers; });
+	int result = best[0].page;
+	if (best[0].inliers < INDEX_MIN_INLIERS)
+		result = max_element(best.begin(), best.end(),
+							 [](const PageCandidate& a, const PageCandidate& b) { return a.score < b.score; })->page;
+	if (candidates) *candidates = best;
+	return result;
+}
+
+String PageIndex::getString() {
+	std::ostringstream temp;
+	temp << "Page index: " << pages.size() << " pages, " << number_of_words << " words, "
+		 << queries << " queries, " << verified << " candidates verified";
+	return temp.str();
+}
@@ -0,0 +1,688 @@
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <iostream>
+#include <stdio.h>
+#include <limits.h>
+#include "Histograms.cpp"
+#include "../CV Common/ResultCache.h"
+
+using namespace cv;
+using namespace std;
+
+#define BOOKIMG		"BookView"
+#define BOOKAMT		25
+#define PAGEIMG		"Page"
+#define PAGEAMT		13
+
+#define PAGEWIDTH	350
+#define PAGEHEIGHT	513
+
+// the page finding (including the corner offsets in Corners) was tuned on
+// book images of this size, so larger photos are decoded down towards it
+#define BOOKWIDTH	1504
+#define BOOKHEIGHT	1000
+
+// corners which move less than this (in pixels) reuse the cached remap
+#define WARP_CORNER_TOLERANCE	0.5
+// sub-pixel precision of the remap, as in opencv's warps
+#define WARP_BITS	5
+#define WARP_SCALE	(1 << WARP_BITS)
+
+// the Canny thresholds of the page edges matched against the templates
+#define MATCH_EDGE_LOW	15
+#define MATCH_EDGE_HIGH	50
+
+// tracking the page from frame to frame in a video: the features followed
+// inside the page, how many of them (as a fraction) must agree with the
+// page's motion, and the smallest number worth fitting the motion to
+#define TRACK_FEATURES		100
+#define TRACK_MIN_FEATURES	20
+#define TRACK_MIN_INLIERS	0.6
+#define TRACK_RANSAC_THRESHOLD	2.0
+// the largest change in page area between frames which is still believed
+#define TRACK_MAX_AREA_CHANGE	0.2
+// the mean grey level difference (on a quarter size page) above which the
+// page content has changed and is matched again
+#define PAGE_CHANGE_THRESHOLD	12.0
+
+// represents and identifies the corners found in the book image
+struct Corners {
+	Point top_left;
+	Point top_right;
+	Point bottom_left;
+	Point bottom_right;
+	
+	vector<Point2f> toVector() {
+		vector<Point2f> p;
+		p.push_back(Point(top_left.x, top_left.y-2));
+		p.push_back(Point(top_right.x+5, top_right.y));
+		p.push_back(Point(bottom_right.x+5, bottom_right.y+5));
+		p.push_back(Point(bottom_left.x-5, bottom_left.y+2));
+		return p;
+	}
+};
+
+/**
+ find the coordinates of the four corners of a noiseless binary image
+ 
+ @param img noiseless binary input image
+ 
+ @return a Corners object identifying the coordinates of each corner
+ */
+Corners findCornerPoints(Mat img) {
+	Corners c;
+	Point right, bottom, top;
+	int startx = -1, endx = -1, starty = -1, endy = -1;
+	for (int i = 0; i < img.cols; i++) {
+		for (int j = 0; j < img.rows; j++) {
+			uchar pval = img.at<uchar>(j,i);
+			if (pval > 0) {
+				if (startx == -1) {
+					c.bottom_left = Point(i,j);
+					startx = i;
+				}
+				if (starty == -1 || starty > j) {
+					top = Point(i,j);
+					starty = j;
+				}
+				if (j > endy) {
+					endy = j;
+					bottom = Point(i,j);
+				}
+				if (i > endx) {
+					endx = i;
+					right = Point(i,j);
+				}
+			}
+		}
+	}
+	c.bottom_right = bottom;
+	c.top_right = right;
+	c.top_left = top;
+	return c;
+}
+
+// transform a book image to a rectangle using the provided corner points
+Mat transformToRectangle(Mat img, Corners c) {
+	cv::Mat result = cv::Mat::zeros(PAGEHEIGHT, PAGEWIDTH, CV_8UC3);
+	
+	std::vector<cv::Point2f> quad_pts;
+	quad_pts.push_back(cv::Point2f(0, 0));
+	quad_pts.push_back(cv::Point2f(result.cols, 0));
+	quad_pts.push_back(cv::Point2f(result.cols, result.rows));
+	quad_pts.push_back(cv::Point2f(0, result.rows));
+	
+	// transformation matrix
+	cv::Mat transmtx = cv::getPerspectiveTransform(c.toVector(), quad_pts);
+	
+	// apply perspective transformation
+	cv::warpPerspective(img, result, transmtx, result.size());
+	return result;
+}
+
+// perform a simple closing
+Mat closing(Mat img, int amt=1) {
+	Mat tmp = img.clone();
+	for (int i = 0; i < amt; i++) {
+		dilate(tmp, tmp, Mat());
+		erode(tmp, tmp, Mat());
+	}
+	return tmp;
+}
+
+// perform a simple erosion
+Mat erosion(Mat img, int amt=1) {
+	for (int i = 0; i < amt; i++)
+		erode(img, img, Mat());
+	return img;
+}
+
+// perform a simple dilation
+Mat dilate(Mat img, int amt=1) {
+	for (int i = 0; i < amt; i++)
+		dilate(img, img, Mat());
+	return img;
+}
+
+// find the corners of the page in a book image
+Corners findPageCorners(Mat img, ColourHistogram h) {
+	TRACE_SCOPE("findPageCorners");
+	// blow up the image 4x to make back projection calculations more
+	// effective
+	Mat large;
+	resize(img, large, Size(), 4, 4);
+	Mat binary, backProject, mask, masked;
+	
+	// build a mask to remove everything that's not part of the page. this
+	// is most effectively achieved by thresholding the red channel and
+	// performing a series of closings, followed my erosions to remove noise
+	vector<Mat> spl;
+	split(large, spl);
+	threshold(spl[0], binary, 0, 255, THRESH_BINARY|THRESH_OTSU);
+	binary = closing(binary, 3);
+	mask = erosion(binary, 3);
+	
+	// apply the mask to the image
+	large.copyTo(masked, mask);
+	cvtColor(masked, masked, CV_BGR2HLS);
+	
+	// back project blue pixels
+	backProject = dilate(h.BackProject(masked), 3);
+	
+	// reduce back to original size
+	resize(backProject, backProject, Size(), 0.25, 0.25);
+	
+	// find the four corner points in the back projected image
+	return findCornerPoints(backProject);
+}
+
+// convert input image to book image
+Mat processImageToPage(Mat img, ColourHistogram h) {
+	TRACE_SCOPE("processImageToPage");
+	return transformToRectangle(img, findPageCorners(img, h));
+}
+
+// returns a list of all of the template images, paired with an edge image
+// version so we don't have to compute the edges each time we try a match
+vector<pair<Mat, Mat>> getTemplateImages(string dir, ColourHistogram h) {
+	vector<pair<Mat, Mat>> v;
+	for (int i = 1; i <= PAGEAMT; i++) {
+		string s = dir+"/"+PAGEIMG+to_string(i)+".JPG";
+		// let the jpeg decoder do as much of the downscaling as it can
+		Mat img = ReadImageAtScale(s, Size(PAGEWIDTH, PAGEHEIGHT));
+		resize(img, img, Size(PAGEWIDTH, PAGEHEIGHT));
+		
+		pair<Mat, Mat> p;
+		GaussianBlur(img, img, Size(3,3), 10);
+		p.first = img;
+
+		Mat edge;
+		Canny(img, edge, 100, 200);
+		// crop out the blue points/lines
+		Rect r = Rect(20, 20, edge.cols - 40, edge.rows - 40);
+		p.second = edge(r);
+		
+		v.push_back(p);
+	}
+	return v;
+}
+
+// read a book image, decoded at the smallest jpeg scale that is still at least
+// the size the page finding was tuned for
+Mat readBookImage(string filename) {
+	return ReadImageAtScale(filename, Size(BOOKWIDTH, BOOKHEIGHT));
+}
+
+// the edges of a grey page image, as matched against the template edges
+Mat getMatchEdges(Mat gray) {
+	Mat edge;
+	Canny(gray, edge, MATCH_EDGE_LOW, MATCH_EDGE_HIGH);
+	return edge;
+}
+
+// the same edges, from the 3x3 sobel gradients of the grey page image
+Mat getMatchEdges(Mat dx, Mat dy) {
+	Mat edge;
+	Canny(dx, dy, edge, MATCH_EDGE_LOW, MATCH_EDGE_HIGH);
+	return edge;
+}
+
+// find the index of the template whose edges best match the edge image
+int matchEdgeImage(Mat edge, vector<pair<Mat, Mat>>& templates) {
+	TRACE_SCOPE("matchEdgeImage");
+	int result = 0;
+	double global_max_correlation = -1;
+	
+	Mat correlation_img;
+	double min_correlation, max_correlation;
+	
+	for (int i = 0; i < templates.size(); i++) {
+		matchTemplate(edge, templates[i].second,
+					  correlation_img, CV_TM_CCORR_NORMED);
+		minMaxLoc(correlation_img, &min_correlation, &max_correlation);
+		if (max_correlation > global_max_correlation) {
+			global_max_correlation = max_correlation;
+			result = i;
+		}
+	}
+	return result;
+}
+
+// find the index of the template image that matches the input image. the edge
+// image that was matched is returned through edge_image, if given
+int getMatchingImage(Mat img, vector<pair<Mat, Mat>>& templates,
+					 Mat* edge_image = NULL) {
+	TRACE_SCOPE("getMatchingImage");
+	Mat gray;
+	cvtColor(img, gray, CV_BGR2GRAY);
+	Mat edge = getMatchEdges(gray);
+	if (edge_image) *edge_image = edge;
+	return matchEdgeImage(edge, templates);
+}
+
+// where the page corners map to in the page image
+vector<Point2f> getPageQuad() {
+	vector<Point2f> quad_pts;
+	quad_pts.push_back(Point2f(0, 0));
+	quad_pts.push_back(Point2f(PAGEWIDTH, 0));
+	quad_pts.push_back(Point2f(PAGEWIDTH, PAGEHEIGHT));
+	quad_pts.push_back(Point2f(0, PAGEHEIGHT));
+	return quad_pts;
+}
+
+// warps book images onto the page geometry straight into a grey image, in
+// place of transformToRectangle followed by a grey conversion. the source
+// position of every page pixel is kept in a table which is reused for as long
+// as the corners stay within the tolerance of the ones it was built for, as
+// they do with a fixed document camera. the table is in the fixed point form
+// of convertMaps: the top left source pixel as a pair of shorts and the
+// sub-pixel offsets as an index into a table of bilinear weights
+class PageWarper {
+public:
+	PageWarper(double tolerance = WARP_CORNER_TOLERANCE);
+	void warpToGray(Mat img, Corners c, Mat& gray) {
+		warpToGray(img, c.toVector(), gray);
+	}
+	void warpToGray(Mat img, vector<Point2f> corners, Mat& gray) {
+		warp(img, corners, gray, false);
+	}
+	void warpToEdges(Mat img, Corners c, Mat& gray, Mat& edges);
+	int getMapsBuilt() {
+		return maps_built;
+	}
+	int getMapsReused() {
+		return maps_reused;
+	}
+	
+private:
+	// a page pixel whose four source pixels are not all inside the book
+	// image, and the (unclamped) top left one of them
+	struct BorderPixel {
+		int page_x;
+		int page_y;
+		int x;
+		int y;
+	};
+	bool mapMatches(vector<Point2f>& corners, Size source_size);
+	void buildMap(vector<Point2f>& corners, Size source_size);
+	void warp(Mat& img, vector<Point2f>& corners, Mat& gray, bool gradients);
+	template<int cn> void warpRow(Mat& img, int y, uchar* out);
+	
+	double corner_tolerance;
+	vector<Point2f> map_corners;
+	Size map_source_size;
+	// CV_16SC2 top left source pixel of each page pixel, clamped so that all
+	// four source pixels are inside the book image
+	Mat map_xy;
+	// CV_16UC1 index of each page pixel's weights: fy*WARP_SCALE + fx
+	Mat map_fraction;
+	// the page pixels which are sampled again with the border taken into
+	// account, in row order
+	vector<BorderPixel> map_border;
+	int weights[WARP_SCALE*WARP_SCALE][4];
+	// the gradients of the grey page, found as its rows are warped
+	Mat gradient_x;
+	Mat gradient_y;
+	int maps_built;
+	int maps_reused;
+};
+
+PageWarper::PageWarper(double tolerance) {
+	corner_tolerance = tolerance;
+	maps_built = 0;
+	maps_reused = 0;
+	for (int fy = 0; fy < WARP_SCALE; fy++) {
+		for (int fx = 0; fx < WARP_SCALE; fx++) {
+			int* w = weights[fy*WARP_SCALE + fx];
+			w[3] = fx*fy;
+			w[1] = fx*WARP_SCALE - w[3];
+			w[2] = fy*WARP_SCALE - w[3];
+			w[0] = WARP_SCALE*WARP_SCALE - w[1] - w[2] - w[3];
+		}
+	}
+}
+
+bool PageWarper::mapMatches(vector<Point2f>& corners, Size source_size) {
+	if (map_xy.empty() || source_size != map_source_size)
+		return false;
+	for (int i = 0; i < corners.size(); i++) {
+		if (fabs(corners[i].x - map_corners[i].x) > corner_tolerance ||
+			fabs(corners[i].y - map_corners[i].y) > corner_tolerance)
+			return false;
+	}
+	return true;
+}
+
+void PageWarper::buildMap(vector<Point2f>& corners, Size source_size) {
+	// the transformation from page pixels back to book pixels
+	Mat inverse = getPerspectiveTransform(getPageQuad(), corners);
+	double m[9];
+	for (int i = 0; i < 9; i++)
+		m[i] = inverse.at<double>(i/3, i%3);
+	map_xy.create(PAGEHEIGHT, PAGEWIDTH, CV_16SC2);
+	map_fraction.create(PAGEHEIGHT, PAGEWIDTH, CV_16UC1);
+	map_border.clear();
+	for (int y = 0; y < PAGEHEIGHT; y++) {
+		short* xy = map_xy.ptr<short>(y);
+		ushort* fraction = map_fraction.ptr<ushort>(y);
+		for (int x = 0; x < PAGEWIDTH; x++) {
+			double w = m[6]*x + m[7]*y + m[8];
+			w = (w != 0) ? WARP_SCALE/w : 0;
+			int sx = saturate_cast<int>((m[0]*x + m[1]*y + m[2])*w);
+			int sy = saturate_cast<int>((m[3]*x + m[4]*y + m[5])*w);
+			int source_x = sx >> WARP_BITS;
+			int source_y = sy >> WARP_BITS;
+			fraction[x] = (ushort) ((sy & (WARP_SCALE-1))*WARP_SCALE + (sx & (WARP_SCALE-1)));
+			if (source_x < 0 || source_y < 0 ||
+				source_x >= source_size.width-1 || source_y >= source_size.height-1) {
+				BorderPixel border = { x, y, source_x, source_y };
+				map_border.push_back(border);
+				source_x = min(max(source_x, 0), source_size.width-2);
+				source_y = min(max(source_y, 0), source_size.height-2);
+			}
+			xy[2*x] = (short) source_x;
+			xy[2*x+1] = (short) source_y;
+		}
+	}
+	map_corners = corners;
+	map_source_size = source_size;
+	maps_built++;
+}
+
+// grey level of a source pixel with 8 fractional bits, using the fixed point
+// weights of cvtColor
+template<int cn> static inline int pixelGray(const uchar* p) {
+	if (cn == 1)
+		return p[0] << 8;
+	return (p[0]*1868 + p[1]*9617 + p[2]*4899 + 32) >> 6;
+}
+
+// as pixelGray, for the page pixels at the border of the map. pixels outside
+// the image are black, as in warpPerspective
+static inline int sourceGray(Mat& img, int x, int y) {
+	if (x < 0 || y < 0 || x >= img.cols || y >= img.rows)
+		return 0;
+	const uchar* p = img.ptr<uchar>(y) + x*img.channels();
+	return (img.channels() == 1) ? pixelGray<1>(p) : pixelGray<3>(p);
+}
+
+// removes the 8 fractional bits of the grey levels and the 2*WARP_BITS of the
+// weights from a bilinear sum, rounding to nearest
+static inline uchar roundGray(int sum) {
+	const int shift = 8 + 2*WARP_BITS;
+	return saturate_cast<uchar>((sum + (1 << (shift-1))) >> shift);
+}
+
+// bilinear sampling of the grey levels of one page row from a book image with
+// cn channels. every source pixel in the map is inside the image, so there
+// are no bounds checks
+template<int cn> void PageWarper::warpRow(Mat& img, int y, uchar* out) {
+	const short* xy = map_xy.ptr<short>(y);
+	const ushort* fraction = map_fraction.ptr<ushort>(y);
+	const uchar* data = img.data;
+	size_t step = img.step;
+	for (int x = 0; x < PAGEWIDTH; x++) {
+		const uchar* p = data + xy[2*x+1]*step + xy[2*x]*cn;
+		const int* w = weights[fraction[x]];
+		out[x] = roundGray(w[0]*pixelGray<cn>(p) + w[1]*pixelGray<cn>(p + cn) +
+						   w[2]*pixelGray<cn>(p + step) + w[3]*pixelGray<cn>(p + step + cn));
+	}
+}
+
+// the 3x3 sobel gradients of one grey page pixel, given the columns to its
+// left and right
+static inline void sobelPixel(const uchar* above, const uchar* row, const uchar* below,
+							  int left, int x, int right, short* dx, short* dy) {
+	dx[x] = (short) ((above[right] - above[left]) + 2*(row[right] - row[left]) +
+					 (below[right] - below[left]));
+	dy[x] = (short) ((below[left] + 2*below[x] + below[right]) -
+					 (above[left] + 2*above[x] + above[right]));
+}
+
+// the sobel gradients of row y of a grey page, with the border replicated as
+// Canny does, so that Canny on them finds the same edges as on the page
+static void sobelRow(Mat& gray, int y, Mat& dx, Mat& dy) {
+	const uchar* above = gray.ptr<uchar>(max(y-1, 0));
+	const uchar* row = gray.ptr<uchar>(y);
+	const uchar* below = gray.ptr<uchar>(min(y+1, gray.rows-1));
+	short* gx = dx.ptr<short>(y);
+	short* gy = dy.ptr<short>(y);
+	int last = gray.cols-1;
+	sobelPixel(above, row, below, 0, 0, 1, gx, gy);
+	for (int x = 1; x < last; x++)
+		sobelPixel(above, row, below, x-1, x, x+1, gx, gy);
+	sobelPixel(above, row, below, last-1, last, last, gx, gy);
+}
+
+// the corners are in the order given by Corners::toVector. if gradients are
+// wanted, each row's are found as soon as the row below it has been warped,
+// while the rows are still in cache
+void PageWarper::warp(Mat& img, vector<Point2f>& corners, Mat& gray, bool gradients) {
+	TRACE_SCOPE("PageWarper::warp");
+	CV_Assert(img.depth() == CV_8U && (img.channels() == 1 || img.channels() == 3));
+	CV_Assert(img.cols >= 2 && img.rows >= 2 && img.cols <= SHRT_MAX && img.rows <= SHRT_MAX);
+	CV_Assert(corners.size() == 4);
+	if (mapMatches(corners, img.size()))
+		maps_reused++;
+	else
+		buildMap(corners, img.size());
+	
+	gray.create(PAGEHEIGHT, PAGEWIDTH, CV_8UC1);
+	if (gradients) {
+		gradient_x.create(PAGEHEIGHT, PAGEWIDTH, CV_16SC1);
+		gradient_y.create(PAGEHEIGHT, PAGEWIDTH, CV_16SC1);
+	}
+	vector<BorderPixel>::iterator border = map_border.begin();
+	for (int y = 0; y < PAGEHEIGHT; y++) {
+		uchar* out = gray.ptr<uchar>(y);
+		if (img.channels() == 1)
+			warpRow<1>(img, y, out);
+		else
+			warpRow<3>(img, y, out);
+		// sample the row's border pixels again from their unclamped positions
+		const ushort* fraction = map_fraction.ptr<ushort>(y);
+		for (; border != map_border.end() && border->page_y == y; border++) {
+			const int* w = weights[fraction[border->page_x]];
+			int sx = border->x, sy = border->y;
+			out[border->page_x] = roundGray(w[0]*sourceGray(img, sx, sy) + w[1]*sourceGray(img, sx+1, sy) +
+											w[2]*sourceGray(img, sx, sy+1) + w[3]*sourceGray(img, sx+1, sy+1));
+		}
+		if (gradients && y > 0)
+			sobelRow(gray, y-1, gradient_x, gradient_y);
+	}
+	if (gradients)
+		sobelRow(gray, PAGEHEIGHT-1, gradient_x, gradient_y);
+}
+
+// the edges for matching are found from gradients taken in the same pass as
+// the warp, rather than by Canny going over the grey page again
+void PageWarper::warpToEdges(Mat img, Corners c, Mat& gray, Mat& edges) {
+	vector<Point2f> corners = c.toVector();
+	warp(img, corners, gray, true);
+	edges = getMatchEdges(gradient_x, gradient_y);
+}
+
+// recognises the page in each frame of a document camera video. rather than
+// finding the page from scratch in every frame, features inside the page are
+// followed with optical flow and the corners are moved with the homography
+// they fit. the page is only found again by segmentation when the tracking
+// can't be trusted, and only matched against the templates again when its
+// content changes, as when the page is turned
+class PageTracker {
+public:
+	PageTracker(ColourHistogram& h) : histogram(h) {
+		tracking = false;
+		match = -1;
+		frames = 0;
+		segmentations = 0;
+		matches = 0;
+	}
+	int processFrame(Mat frame, vector<pair<Mat, Mat>>& templates);
+	// the corners of the page in the last frame, as for Corners::toVector
+	vector<Point2f> getCorners() {
+		return corners;
+	}
+	// the rectified grey page of the last frame
+	Mat getPage() {
+		return page;
+	}
+	// the edges which were last matched
+	Mat getMatchedEdges() {
+		return matched_edges;
+	}
+	int getSegmentations() {
+		return segmentations;
+	}
+	int getMatches() {
+		return matches;
+	}
+	String getString();
+	
+private:
+	bool trackCorners(Mat& gray);
+	void findFeatures();
+	
+	ColourHistogram& histogram;
+	PageWarper warper;
+	Mat previous_gray;
+	vector<Point2f> features;
+	vector<Point2f> corners;
+	bool tracking;
+	Mat page;
+	Mat matched_page;
+	Mat matched_edges;
+	int match;
+	int frames;
+	int segmentations;
+	int matches;
+};
+
+// choose features to follow within the page in the previous frame
+void PageTracker::findFeatures() {
+	Mat mask = Mat::zeros(previous_gray.size(), CV_8UC1);
+	vector<Point> quad;
+	for (int i = 0; i < corners.size(); i++)
+		quad.push_back(Point(cvRound(corners[i].x), cvRound(corners[i].y)));
+	fillConvexPoly(mask, quad, Scalar(255));
+	goodFeaturesToTrack(previous_gray, features, TRACK_FEATURES, 0.01, 5, mask);
+}
+
+// move the corners with the features from the previous frame. returns false
+// if the motion of the features doesn't fit a homography well enough or
+// the page changes size implausibly
+bool PageTracker::trackCorners(Mat& gray) {
+	TRACE_SCOPE("PageTracker::trackCorners");
+	if (features.size() < TRACK_MIN_FEATURES)
+		findFeatures();
+	if (features.size() < TRACK_MIN_FEATURES)
+		return false;
+	vector<Point2f> tracked;
+	vector<uchar> found;
+	vector<float> error;
+	calcOpticalFlowPyrLK(previous_gray, gray, features, tracked, found, error);
+	vector<Point2f> from, to;
+	for (int i = 0; i < features.size(); i++) {
+		if (found[i]) {
+			from.push_back(features[i]);
+			to.push_back(tracked[i]);
+		}
+	}
+	if (from.size() < TRACK_MIN_FEATURES)
+		return false;
+	Mat inlier_mask;
+	Mat motion = findHomography(from, to, RANSAC, TRACK_RANSAC_THRESHOLD, inlier_mask);
+	if (motion.empty() || countNonZero(inlier_mask) < TRACK_MIN_INLIERS*from.size())
+		return false;
+	
+	vector<Point2f> moved;
+	perspectiveTransform(corners, moved, motion);
+	double area = contourArea(corners), moved_area = contourArea(moved);
+	if (!isContourConvex(moved) || fabs(moved_area-area) > TRACK_MAX_AREA_CHANGE*area)
+		return false;
+	corners = moved;
+	// only the features which moved with the page are followed further
+	features.clear();
+	for (int i = 0; i < to.size(); i++)
+		if (inlier_mask.at<uchar>(i))
+			features.push_back(to[i]);
+	return true;
+}
+
+/**
+ * Recognise the page in the next frame of a video.
+ * @param frame the BGR frame
+ * @param templates the template images, as from getTemplateImages
+ * @return the index of the matching template
+ */
+int PageTracker::processFrame(Mat frame, vector<pair<Mat, Mat>>& templates) {
+	TRACE_SCOPE("PageTracker::processFrame");
+	frames++;
+	Mat gray;
+	cvtColor(frame, gray, CV_BGR2GRAY);
+	if (!tracking || !trackCorners(gray)) {
+		corners = findPageCorners(frame, histogram).toVector();
+		segmentations++;
+		features.clear();
+	}
+	tracking = true;
+	previous_gray = gray;
+	
+	warper.warpToGray(frame, corners, page);
+	bool changed = (match < 0);
+	if (!changed) {
+		// compare small copies, which ignores noise and slight misalignment
+		Mat small_page, small_matched;
+		resize(page, small_page, Size(), 0.25, 0.25, INTER_AREA);
+		resize(matched_page, small_matched, Size(), 0.25, 0.25, INTER_AREA);
+		changed = norm(small_page, small_matched, NORM_L1)/small_page.total() > PAGE_CHANGE_THRESHOLD;
+	}
+	if (changed) {
+		matched_edges = getMatchEdges(page);
+		match = matchEdgeImage(matched_edges, templates);
+		matched_page = page.clone();
+		matches++;
+	}
+	return match;
+}
+
+String PageTracker::getString() {
+	std::ostringstream temp;
+	temp << "Page tracker: " << frames << " frames, " << segmentations << " segmented, "
+		 << matches << " matched";
+	return temp.str();
+}
+
+// describes the recognition, its parameters and the templates, so that cached
+// matches are only used with the same version of the recognition and the same
+// set of templates
+string getRecognitionVersion(vector<pair<Mat, Mat>>& templates, bool use_index) {
+	uint64 templates_hash = 0;
+	for (int i = 0; i < templates.size(); i++)
+		templates_hash = HashImage(templates[i].second, templates_hash);
+	ostringstream version;
+	version << "lab3-recognition 1 page=" << PAGEWIDTH << "x" << PAGEHEIGHT
+			<< " book=" << BOOKWIDTH << "x" << BOOKHEIGHT
+			<< " method=" << (use_index ? "index" : "edges")
+			<< " templates=" << templates_hash;
+	return version.str();
+}
+
+// returns the two input images displayed side by side (for display only)
+Mat getDisplayImage(Mat img, int imgno, Mat t, int tempno) {
+	Size s1 = img.size();
+	Size s2 = t.size();
+	Mat result(s1.height, s1.width+s2.width, CV_8UC3);
+	Mat left(result, Rect(0, 0, s1.width, s1.height));
+	img.copyTo(left);
+	Mat right(result, Rect(s1.width, 0, s2.width, s2.height));
+	t.copyTo(right);
+	
+	putText(result, BOOKIMG+to_string(imgno), cvPoint(10,20),
+			FONT_HERSHEY_PLAIN, 1, cvScalar(0,0,250), 1, CV_8UC3);
+	putText(result, PAGEIMG+to_string(tempno), cvPoint(PAGEWIDTH+10,20),
+			FONT_HERSHEY_PLAIN, 1, cvScalar(0,0,250), 1, CV_8UC3);
+	
+	return result;
+}
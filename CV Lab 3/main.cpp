@@ -4,233 +4,58 @@
 
 #include <iostream>
 #include <stdio.h>
-#include "Histograms.cpp"
+#include "Recognition.cpp"
+#include "PageIndex.cpp"
+#include "../CV Common/Utilities.cpp"
+#include "../CV Common/ResultCache.cpp"
 
 using namespace cv;
 using namespace std;
 
-#define BOOKIMG		"BookView"
-#define BOOKAMT		25
-#define PAGEIMG		"Page"
-#define PAGEAMT		13
-
-#define PAGEWIDTH	350
-#define PAGEHEIGHT	513
-
-// represents and identifies the corners found in the book image
-struct Corners {
-	Point top_left;
-	Point top_right;
-	Point bottom_left;
-	Point bottom_right;
-	
-	vector<Point2f> toVector() {
-		vector<Point2f> p;
-		p.push_back(Point(top_left.x, top_left.y-2));
-		p.push_back(Point(top_right.x+5, top_right.y));
-		p.push_back(Point(bottom_right.x+5, bottom_right.y+5));
-		p.push_back(Point(bottom_left.x-5, bottom_left.y+2));
-		return p;
-	}
-};
-
-/**
- find the coordinates of the four corners of a noiseless binary image
- 
- @param img noiseless binary input image
- 
- @return a Corners object identifying the coordinates of each corner
- */
-Corners findCornerPoints(Mat img) {
-	Corners c;
-	Point right, bottom, top;
-	int startx = -1, endx = -1, starty = -1, endy = -1;
-	for (int i = 0; i < img.cols; i++) {
-		for (int j = 0; j < img.rows; j++) {
-			uchar pval = img.at<uchar>(j,i);
-			if (pval > 0) {
-				if (startx == -1) {
-					c.bottom_left = Point(i,j);
-					startx = i;
-				}
-				if (starty == -1 || starty > j) {
-					top = Point(i,j);
-					starty = j;
-				}
-				if (j > endy) {
-					endy = j;
-					bottom = Point(i,j);
-				}
-				if (i > endx) {
-					endx = i;
-					right = Point(i,j);
-				}
-			}
-		}
-	}
-	c.bottom_right = bottom;
-	c.top_right = right;
-	c.top_left = top;
-	return c;
-}
-
-// transform a book image to a rectangle using the provided corner points
-Mat transformToRectangle(Mat img, Corners c) {
-	cv::Mat result = cv::Mat::zeros(PAGEHEIGHT, PAGEWIDTH, CV_8UC3);
-	
-	std::vector<cv::Point2f> quad_pts;
-	quad_pts.push_back(cv::Point2f(0, 0));
-	quad_pts.push_back(cv::Point2f(result.cols, 0));
-	quad_pts.push_back(cv::Point2f(result.cols, result.rows));
-	quad_pts.push_back(cv::Point2f(0, result.rows));
-	
-	// transformation matrix
-	cv::Mat transmtx = cv::getPerspectiveTransform(c.toVector(), quad_pts);
-	
-	// apply perspective transformation
-	cv::warpPerspective(img, result, transmtx, result.size());
-	return result;
-}
-
-// perform a simple closing
-Mat closing(Mat img, int amt=1) {
-	Mat tmp = img.clone();
-	for (int i = 0; i < amt; i++) {
-		dilate(tmp, tmp, Mat());
-		erode(tmp, tmp, Mat());
-	}
-	return tmp;
-}
-
-// perform a simple erosion
-Mat erosion(Mat img, int amt=1) {
-	for (int i = 0; i < amt; i++)
-		erode(img, img, Mat());
-	return img;
-}
-
-// perform a simple dilation
-Mat dilate(Mat img, int amt=1) {
-	for (int i = 0; i < amt; i++)
-		dilate(img, img, Mat());
-	return img;
-}
-
-// convert input image to book image
-Mat processImageToPage(Mat img, ColourHistogram h) {
-	// blow up the image 4x to make back projection calculations more
-	// effective
-	resize(img, img, Size(), 4, 4);
-	Mat binary, backProject, eroded, dilated, hls, mask, masked, transformed;
-	cvtColor(img, hls, CV_BGR2HLS);
-	
-	// build a mask to remove everything that's not part of the page. this
-	// is most effectively achieved by thresholding the red channel and
-	// performing a series of closings, followed my erosions to remove noise
-	vector<Mat> spl;
-	split(img, spl);
-	threshold(spl[0], binary, 0, 255, THRESH_BINARY|THRESH_OTSU);
-	binary = closing(binary, 3);
-	mask = erosion(binary, 3);
-	
-	// apply the mask to the image
-	img.copyTo(masked, mask);
-	cvtColor(masked, masked, CV_BGR2HLS);
-	
-	// back project blue pixels
-	backProject = dilate(h.BackProject(masked), 3);
-	
-	// reduce image back to original size
-	resize(img, img, Size(), 0.25, 0.25);
-	resize(backProject, backProject, Size(), 0.25, 0.25);
-	
-	// find the four corner points in the back projected image
-	Corners corners = findCornerPoints(backProject);
-	cvtColor(backProject, backProject, CV_GRAY2BGR);
-	circle(backProject, corners.bottom_left, 3, Scalar(255, 255, 255), 10);
-	circle(backProject, corners.top_left, 3, Scalar(0, 0, 255), 10);
-	circle(backProject, corners.top_right, 3, Scalar(0, 255, 0), 10);
-	circle(backProject, corners.bottom_right, 3, Scalar(255, 0, 0), 10);
-	
-	return transformToRectangle(img, corners);
-}
-
-// returns a list of all of the template images, paired with an edge image
-// version so we don't have to compute the edges each time we try a match
-vector<pair<Mat, Mat>> getTemplateImages(string dir, ColourHistogram h) {
-	vector<pair<Mat, Mat>> v;
-	for (int i = 1; i <= PAGEAMT; i++) {
-		string s = dir+"/"+PAGEIMG+to_string(i)+".JPG";
-		Mat img = imread(s);
-		resize(img, img, Size(PAGEWIDTH, PAGEHEIGHT));
-		
-		pair<Mat, Mat> p;
-		GaussianBlur(img, img, Size(3,3), 10);
-		p.first = img;
-
-		Mat edge;
-		Canny(img, edge, 100, 200);
-		// crop out the blue points/lines
-		Rect r = Rect(20, 20, edge.cols - 40, edge.rows - 40);
-		p.second = edge(r);
-		
-		v.push_back(p);
-	}
-	return v;
-}
-
-// find the index of the template image that matches the input image
-int getMatchingImage(Mat img, vector<pair<Mat, Mat>>& templates) {
-	int result = 0;
-	double global_max_correlation = -1;
-	
-	Mat edge;
-	cvtColor(img, img, CV_BGR2GRAY);
-	Canny(img, edge, 50, 15);
-	
-	Mat correlation_img, test;
-	double min_correlation, max_correlation;
+int main(int argc, char* argv[]) {
 	
-	for (int i = 0; i < templates.size(); i++) {
-		matchTemplate(edge, templates[i].second,
-					  correlation_img, CV_TM_CCORR_NORMED);
-		minMaxLoc(correlation_img, &min_correlation, &max_correlation);
-		if (max_correlation > global_max_correlation) {
-			global_max_correlation = max_correlation;
-			result = i;
+	// -index finds the pages with the local-feature index instead of
+	// correlating the edges of the rectified page. -video follows the page
+	// through a document camera video (or a camera number) instead of reading
+	// the book images. -cache keeps the matches in a directory, so that book
+	// images which have been recognised before are not processed again
+	bool use_index = false;
+	string video_source, cache_directory;
+	while (argc > 1) {
+		if (string(argv[1]) == "-index") {
+			use_index = true;
+			argc--;
+			argv++;
+		} else if (argc > 2 && string(argv[1]) == "-video") {
+			video_source = argv[2];
+			argc -= 2;
+			argv += 2;
+		} else if (argc > 2 && string(argv[1]) == "-cache") {
+			cache_directory = argv[2];
+			argc -= 2;
+			argv += 2;
+		} else {
+			break;
 		}
 	}
-	imshow("src", edge);
-	imshow("template", templates[result].second);
-	return result;
-}
-
-// returns the two input images displayed side by side (for display only)
-Mat getDisplayImage(Mat img, int imgno, Mat t, int tempno) {
-	Size s1 = img.size();
-	Size s2 = t.size();
-	Mat result(s1.height, s1.width+s2.width, CV_8UC3);
-	Mat left(result, Rect(0, 0, s1.width, s1.height));
-	img.copyTo(left);
-	Mat right(result, Rect(s1.width, 0, s2.width, s2.height));
-	t.copyTo(right);
-	
-	putText(result, BOOKIMG+to_string(imgno), cvPoint(10,20),
-			FONT_HERSHEY_PLAIN, 1, cvScalar(0,0,250), 1, CV_8UC3);
-	putText(result, PAGEIMG+to_string(tempno), cvPoint(PAGEWIDTH+10,20),
-			FONT_HERSHEY_PLAIN, 1, cvScalar(0,0,250), 1, CV_8UC3);
-	
-	return result;
-}
-
-int main(int argc, char* argv[]) {
-	
-	if (argc < 1) {
-		cout << "Usage: " << argv[0] << " [img dir]" << endl;
+	if (argc < 2) {
+		cout << "Usage: " << argv[0]
+			<< " [-index] [-video source] [-cache dir] [img dir] [timings.json|timings.csv] [trace.json]" << endl;
 		return 0;
 	}
 	
 	string dir = argv[1];
+	// optionally export the per-stage timings once every image is processed
+	string timings_file = (argc > 2) ? argv[2] : "";
+	string trace_file = (argc > 3) ? argv[3] : "";
+	Timestamper timer;
+	int templates_event = timer.registerEvent("Templates");
+	int load_event = timer.registerEvent("Load");
+	int page_event = timer.registerEvent("Page");
+	int match_event = timer.registerEvent("Match");
+	int display_event = timer.registerEvent("Display");
+	int cache_event = timer.registerEvent("Cache");
+	
 	Mat bluePixels = imread(dir+"/BlueBookPixelsNew.png");
 	
 	// calculate histogram of blue pixels for back projection
@@ -238,23 +63,111 @@ int main(int argc, char* argv[]) {
 	ColourHistogram h = ColourHistogram(bluePixels, 4);
 	
 	vector<pair<Mat, Mat>> templates = getTemplateImages(dir, h);
+	PageIndex index;
+	if (use_index) {
+		vector<Mat> pages;
+		for (int i = 0; i < templates.size(); i++)
+			pages.push_back(templates[i].first);
+		index.train(pages);
+		for (int i = 0; i < pages.size(); i++)
+			index.addPage(pages[i]);
+	}
+	ResultCache cache(getRecognitionVersion(templates, use_index), cache_directory);
+	timer.recordTime(templates_event);
+	
+	if (!video_source.empty()) {
+		VideoCapture video;
+		bool is_camera = video_source.find_first_not_of("0123456789") == string::npos;
+		if (is_camera ? !video.open(atoi(video_source.c_str())) : !video.open(video_source)) {
+			cout << "Could not open the video source: " << video_source << endl;
+			return -1;
+		}
+		PageTracker tracker(h);
+		Mat frame;
+		while (true) {
+			timer.ignoreTimeSinceLastRecorded();
+			if (!video.read(frame))
+				break;
+			timer.recordTime(load_event);
+			int match = tracker.processFrame(frame, templates);
+			timer.recordTime(page_event);
+			
+			Mat transformed;
+			cvtColor(tracker.getPage(), transformed, CV_GRAY2BGR);
+			imshow("Page", getDisplayImage(transformed, 0, templates[match].first, match));
+			timer.recordTime(display_event);
+			if (waitKey(1) >= 0)
+				break;
+		}
+		cout << tracker.getString() << endl;
+	}
 	
-	for (int i = 1; i <= BOOKAMT; i++) {
+	// the remap from book to page is reused while the corners don't move
+	PageWarper warper;
+	for (int i = 1; video_source.empty() && i <= BOOKAMT; i++) {
+		// don't count the time spent waiting for a keypress
+		timer.ignoreTimeSinceLastRecorded();
 		string s = dir+"/"+BOOKIMG+to_string(i)+".jpg";
-		Mat img = imread(s);
+		uint64 file_hash;
+		bool hashed = !cache_directory.empty() && HashFile(s, file_hash);
+		vector<double> cached;
+		bool is_cached = hashed && cache.Lookup(file_hash, cached) && cached.size() == 1 &&
+			cached[0] >= 0 && cached[0] < templates.size();
+		if (hashed) timer.recordTime(cache_event);
+		if (is_cached) {
+			// a book image recognised before isn't decoded at all, so there is
+			// no page to show, only the template it matched
+			int match = (int) cached[0];
+			cout << BOOKIMG << i << " matches " << PAGEIMG << match << " (cached)" << endl;
+			imshow("template", templates[match].second);
+			timer.recordTime(display_event);
+			waitKey(0);
+			continue;
+		}
+		Mat img = readBookImage(s);
+		timer.recordTime(load_event);
 		
-		// transform the book image to a page image
-		Mat transformed = processImageToPage(img, h);
+		// transform the book image to a grey page image and its edges
+		Mat gray, edge;
+		warper.warpToEdges(img, findPageCorners(img, h), gray, edge);
+		timer.recordTime(page_event);
 		// find the id of the template that matches the page image
-		int match = getMatchingImage(transformed, templates);
+		int match = use_index ? index.query(img) : matchEdgeImage(edge, templates);
+		if (match < 0) match = 0;
+		timer.recordTime(match_event);
+		if (hashed) {
+			vector<double> result(1, match);
+			cache.Store(file_hash, result);
+		}
+		
+		imshow("src", edge);
+		imshow("template", templates[match].second);
 		
 		// display the page image and the matching template side by side
+		Mat transformed;
+		cvtColor(gray, transformed, CV_GRAY2BGR);
 		Mat display = getDisplayImage(transformed, i,
 									  templates[match].first, match);
 		// show the two images side by side
 		imshow(s, display);
+		timer.recordTime(display_event);
+		waitKey(0);
+	}
+	if (use_index) {
+		cout << index.getString() << endl;
+	}
+	if (!cache_directory.empty()) {
+		cout << cache.getString() << endl;
+	}
+	if (!timings_file.empty()) {
+		timer.exportTimes(timings_file);
+	}
+	// the trace is only populated in builds with ENABLE_TRACING defined
+	if (!trace_file.empty()) {
+		Tracer::exportChromeTrace(trace_file);
+	}
+	if (video_source.empty()) {
 		waitKey(0);
 	}
-	waitKey(0);
 	return 0;
 }
@@ -0,0 +1,419 @@
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <stdio.h>
+
+#include "../CV Common/Utilities.h"
+
+using namespace cv;
+using namespace std;
+
+#define CLIP_PRE_ROLL_SECONDS	5.0
+#define CLIP_POST_ROLL_SECONDS	5.0
+#define CLIP_MAXIMUM_SECONDS	60.0
+#define CLIP_BUFFER_BYTES		(64*1024*1024)
+#define CLIP_JPEG_QUALITY		85
+#define CLIP_MAXIMUM_PENDING	4
+
+// A JPEG encoded frame.  Each frame is held in exactly one place (the ring
+// buffer, the active clip or a finished clip), so the bytes held are simply
+// the sum of those places.
+struct EncodedFrame {
+	int mFrameNumber;
+	shared_ptr<vector<uchar> > mData;
+};
+
+// One trigger.  A trigger while a clip is recording is added to that clip.
+struct ClipEvent {
+	int mEventNumber;
+	int mTriggerFrame;
+	Rect mDetection;
+};
+
+// A clip is named after its first event.  A clip which reaches the maximum
+// length is finished and continued in a further part, which has the same name
+// with the part number appended.
+struct EventClip {
+	int mEventNumber;
+	int mPart;
+	int mLastFrame;
+	bool mContinued;
+	size_t mBytes;
+	vector<ClipEvent> mEvents;
+	vector<EncodedFrame> mFrames;
+};
+
+// Keeps the last few seconds of frames JPEG encoded in memory, and when an
+// event is triggered writes a clip running from the pre-roll before the event
+// to the post-roll after it, along with a JSON record of each event in the
+// clip.  Clips are at most a maximum length.  Finished clips are decoded and
+// written on a separate thread; if more than CLIP_MAXIMUM_PENDING clips are
+// waiting the newest is dropped.  All of the encoded frames (the pre-roll,
+// the active clip, and the clips waiting to be written) are counted against
+// one limit on memory.  When over it, the pre-roll is given up first, then
+// the waiting clips (newest first), and then the oldest frames of the active
+// clip.  The events of a dropped clip are still recorded, without a clip.
+class EventClipRecorder
+{
+private:
+	String mDirectory;
+	double mFPS;
+	int mPreRollFrames;
+	int mPostRollFrames;
+	int mMaximumClipFrames;
+	size_t mMaximumBufferBytes;
+	int mJPEGQuality;
+	deque<EncodedFrame> mRingBuffer;
+	size_t mBufferBytes;
+	EventClip* mActiveClip;
+	int mEventCount;
+	int mClipsWritten;
+	int mClipsDropped;
+	int mFramesDropped;
+	deque<EventClip*> mPendingClips;
+	size_t mPendingBytes;
+	bool mClosing;
+	std::mutex mLock;
+	std::condition_variable mClipPending;
+	std::thread mWriterThread;
+	void FinishActiveClip();
+	void LimitMemory();
+	void WriteClips();
+	String getClipName( EventClip& clip );
+	bool WriteClip( EventClip& clip );
+	void WriteEventRecords( EventClip& clip, bool written );
+	void DropClip( EventClip* clip );
+public:
+	EventClipRecorder( String directory, double fps, double pre_roll_seconds=CLIP_PRE_ROLL_SECONDS,
+					   double post_roll_seconds=CLIP_POST_ROLL_SECONDS, size_t maximum_buffer_bytes=CLIP_BUFFER_BYTES,
+					   int jpeg_quality=CLIP_JPEG_QUALITY, double maximum_clip_seconds=CLIP_MAXIMUM_SECONDS );
+	~EventClipRecorder();
+	void AddFrame( Mat& frame, int frame_number );
+	void TriggerEvent( Rect detection, int frame_number );
+	void Close();
+	// Bytes of encoded frames held in the pre-roll, the active clip and the
+	// clips waiting to be written
+	size_t getBufferBytes();
+	int getEventCount()
+	{
+		return mEventCount;
+	}
+	String getString();
+};
+
+EventClipRecorder::EventClipRecorder( String directory, double fps, double pre_roll_seconds, double post_roll_seconds,
+									  size_t maximum_buffer_bytes, int jpeg_quality, double maximum_clip_seconds )
+{
+	mDirectory = directory;
+	// some containers don't report a frame rate
+	mFPS = (fps > 0.0) ? fps : 25.0;
+	mPreRollFrames = std::max(0, cvRound(pre_roll_seconds*mFPS));
+	mPostRollFrames = std::max(0, cvRound(post_roll_seconds*mFPS));
+	mMaximumClipFrames = std::max(1, cvRound(maximum_clip_seconds*mFPS));
+	mMaximumBufferBytes = maximum_buffer_bytes;
+	mJPEGQuality = jpeg_quality;
+	mBufferBytes = 0;
+	mActiveClip = NULL;
+	mEventCount = 0;
+	mClipsWritten = 0;
+	mClipsDropped = 0;
+	mFramesDropped = 0;
+	mPendingBytes = 0;
+	mClosing = false;
+	mWriterThread = std::thread(&EventClipRecorder::WriteClips, this);
+}
+
+EventClipRecorder::~EventClipRecorder()
+{
+	Close();
+}
+
+// While a clip is recording, frames go into the clip rather than the ring
+// buffer.  The ring buffer starts again once the clip has finished, so the
+// pre-roll of the next clip never repeats frames which were in the last one.
+void EventClipRecorder::AddFrame( Mat& frame, int frame_number )
+{
+	TRACE_SCOPE("EventClipRecorder::AddFrame");
+	EncodedFrame encoded;
+	encoded.mFrameNumber = frame_number;
+	encoded.mData = make_shared<vector<uchar> >();
+	vector<int> parameters;
+	parameters.push_back(IMWRITE_JPEG_QUALITY);
+	parameters.push_back(mJPEGQuality);
+	imencode(".jpg", frame, *encoded.mData, parameters);
+
+	if (mActiveClip != NULL)
+	{
+		mActiveClip->mFrames.push_back(encoded);
+		mActiveClip->mBytes += encoded.mData->size();
+		if (frame_number >= mActiveClip->mLastFrame)
+			FinishActiveClip();
+		else if ((int) mActiveClip->mFrames.size() >= mMaximumClipFrames)
+		{
+			// a clip which is still being extended by new triggers is cut
+			// at the maximum length and carries on in a new part
+			EventClip* continuation = new EventClip();
+			continuation->mEventNumber = mActiveClip->mEventNumber;
+			continuation->mPart = mActiveClip->mPart+1;
+			continuation->mLastFrame = mActiveClip->mLastFrame;
+			continuation->mContinued = false;
+			continuation->mBytes = 0;
+			mActiveClip->mContinued = true;
+			FinishActiveClip();
+			mActiveClip = continuation;
+		}
+	}
+	else
+	{
+		mRingBuffer.push_back(encoded);
+		mBufferBytes += encoded.mData->size();
+		while ((int) mRingBuffer.size() > mPreRollFrames+1)
+		{
+			mBufferBytes -= mRingBuffer.front().mData->size();
+			mRingBuffer.pop_front();
+		}
+	}
+	LimitMemory();
+}
+
+// Starts a clip whose pre-roll is the buffered frames before frame_number.
+// The frame itself should be added after the trigger.  A trigger while a clip
+// is still recording extends that clip, and is recorded as an event of it.
+void EventClipRecorder::TriggerEvent( Rect detection, int frame_number )
+{
+	mEventCount++;
+	ClipEvent event;
+	event.mEventNumber = mEventCount;
+	event.mTriggerFrame = frame_number;
+	event.mDetection = detection;
+	if (mActiveClip != NULL)
+	{
+		mActiveClip->mLastFrame = std::max(mActiveClip->mLastFrame, frame_number+mPostRollFrames);
+		mActiveClip->mEvents.push_back(event);
+		return;
+	}
+	mActiveClip = new EventClip();
+	mActiveClip->mEventNumber = mEventCount;
+	mActiveClip->mPart = 1;
+	mActiveClip->mLastFrame = frame_number+mPostRollFrames;
+	mActiveClip->mContinued = false;
+	mActiveClip->mBytes = 0;
+	mActiveClip->mEvents.push_back(event);
+	// the pre-roll moves out of the ring buffer into the clip
+	for (deque<EncodedFrame>::iterator buffered = mRingBuffer.begin(); buffered != mRingBuffer.end(); buffered++)
+		if (buffered->mFrameNumber < frame_number)
+		{
+			mActiveClip->mFrames.push_back(*buffered);
+			mActiveClip->mBytes += buffered->mData->size();
+		}
+	mRingBuffer.clear();
+	mBufferBytes = 0;
+}
+
+void EventClipRecorder::FinishActiveClip()
+{
+	EventClip* clip = mActiveClip;
+	mActiveClip = NULL;
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		if ((int) mPendingClips.size() < CLIP_MAXIMUM_PENDING)
+		{
+			mPendingClips.push_back(clip);
+			mPendingBytes += clip->mBytes;
+			clip = NULL;
+		}
+	}
+	if (clip != NULL)
+		DropClip(clip);
+	else mClipPending.notify_one();
+}
+
+// Records the events of a clip which won't be written, and frees it
+void EventClipRecorder::DropClip( EventClip* clip )
+{
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		mClipsDropped++;
+	}
+	WriteEventRecords(*clip, false);
+	delete clip;
+}
+
+// Gives up frames and clips until the encoded frames held are within the
+// limit.  The clip being written (which is no longer pending) still counts
+// until it has been written, but can't be given up.
+void EventClipRecorder::LimitMemory()
+{
+	vector<EventClip*> dropped_clips;
+	std::unique_lock<std::mutex> lock(mLock);
+	size_t active_bytes = (mActiveClip != NULL) ? mActiveClip->mBytes : 0;
+	while (!mRingBuffer.empty() && (mBufferBytes+active_bytes+mPendingBytes > mMaximumBufferBytes))
+	{
+		mBufferBytes -= mRingBuffer.front().mData->size();
+		mRingBuffer.pop_front();
+		mFramesDropped++;
+	}
+	while (!mPendingClips.empty() && (mBufferBytes+active_bytes+mPendingBytes > mMaximumBufferBytes))
+	{
+		EventClip* clip = mPendingClips.back();
+		mPendingClips.pop_back();
+		mPendingBytes -= clip->mBytes;
+		dropped_clips.push_back(clip);
+	}
+	// the newest frame of the active clip is always kept
+	if ((mActiveClip != NULL) && (mBufferBytes+active_bytes+mPendingBytes > mMaximumBufferBytes))
+	{
+		vector<EncodedFrame>& frames = mActiveClip->mFrames;
+		int dropped = 0;
+		while ((dropped < (int) frames.size()-1) && (mBufferBytes+mActiveClip->mBytes+mPendingBytes > mMaximumBufferBytes))
+			mActiveClip->mBytes -= frames[dropped++].mData->size();
+		frames.erase(frames.begin(), frames.begin()+dropped);
+		mFramesDropped += dropped;
+	}
+	// the records are written without the lock, so the writer thread isn't held up
+	lock.unlock();
+	for (int index=0; index < (int) dropped_clips.size(); index++)
+		DropClip(dropped_clips[index]);
+}
+
+void EventClipRecorder::WriteClips()
+{
+	for (;;)
+	{
+		EventClip* clip = NULL;
+		{
+			std::unique_lock<std::mutex> lock(mLock);
+			mClipPending.wait(lock, [this] { return !mPendingClips.empty() || mClosing; });
+			if (mPendingClips.empty())
+				return;
+			clip = mPendingClips.front();
+			mPendingClips.pop_front();
+		}
+		bool written = WriteClip(*clip);
+		WriteEventRecords(*clip, written);
+		std::lock_guard<std::mutex> lock(mLock);
+		mPendingBytes -= clip->mBytes;
+		delete clip;
+		if (written)
+			mClipsWritten++;
+	}
+}
+
+// A clip is named after its first event, with the part number appended to
+// its continuations
+String EventClipRecorder::getClipName( EventClip& clip )
+{
+	char name[32];
+	if (clip.mPart == 1)
+		sprintf(name, "event_%04d", clip.mEventNumber);
+	else sprintf(name, "event_%04d_part%d", clip.mEventNumber, clip.mPart);
+	return String(name) + ".avi";
+}
+
+bool EventClipRecorder::WriteClip( EventClip& clip )
+{
+	TRACE_SCOPE("EventClipRecorder::WriteClip");
+	if (clip.mFrames.empty())
+		return false;
+	String clip_path = mDirectory + "/" + getClipName(clip);
+
+	VideoWriter clip_video;
+	Mat frame;
+	for (int index=0; index < (int) clip.mFrames.size(); index++)
+	{
+		imdecode(*clip.mFrames[index].mData, IMREAD_COLOR, &frame);
+		if (!clip_video.isOpened())
+		{
+			clip_video.open(clip_path, VideoWriter::fourcc('M','J','P','G'), mFPS, frame.size(), true);
+			if (!clip_video.isOpened())
+			{
+				cout << "Could not open the event clip for write: " << clip_path << endl;
+				return false;
+			}
+		}
+		clip_video.write(frame);
+	}
+	clip_video.release();
+	return true;
+}
+
+// Writes a record of each of the events which were triggered in a clip.
+// Continuations of a clip have no events of their own, but the record of each
+// event says whether its clip was continued.  The events of a clip which was
+// dropped (or couldn't be written) are recorded with a null clip, and the
+// frames are those the clip held when it was given up.
+void EventClipRecorder::WriteEventRecords( EventClip& clip, bool written )
+{
+	String clip_name = getClipName(clip);
+	for (int index=0; index < (int) clip.mEvents.size(); index++)
+	{
+		ClipEvent& event = clip.mEvents[index];
+		int first_frame = clip.mFrames.empty() ? event.mTriggerFrame : clip.mFrames.front().mFrameNumber;
+		int last_frame = clip.mFrames.empty() ? event.mTriggerFrame : clip.mFrames.back().mFrameNumber;
+		char name[32];
+		sprintf(name, "event_%04d", event.mEventNumber);
+		String record_path = mDirectory + "/" + String(name) + ".json";
+		ofstream record(record_path.c_str());
+		if (!record.is_open())
+		{
+			cout << "Could not open the event record for write: " << record_path << endl;
+			continue;
+		}
+		record << "{\n  \"event\": " << event.mEventNumber;
+		if (written)
+			record << ",\n  \"clip\": \"" << EscapeJSON(clip_name) << "\"";
+		else record << ",\n  \"clip\": null";
+		record << ",\n  \"dropped\": " << (written ? "false" : "true")
+			   << ",\n  \"continued\": " << (clip.mContinued ? "true" : "false")
+			   << ",\n  \"fps\": " << mFPS
+			   << ",\n  \"first_frame\": " << first_frame
+			   << ",\n  \"trigger_frame\": " << event.mTriggerFrame
+			   << ",\n  \"last_frame\": " << last_frame
+			   << ",\n  \"trigger_time_s\": " << event.mTriggerFrame/mFPS
+			   << ",\n  \"pre_roll_s\": " << (event.mTriggerFrame-first_frame)/mFPS
+			   << ",\n  \"post_roll_s\": " << (last_frame-event.mTriggerFrame)/mFPS
+			   << ",\n  \"detection\": {\"x\": " << event.mDetection.x << ", \"y\": " << event.mDetection.y
+			   << ", \"width\": " << event.mDetection.width << ", \"height\": " << event.mDetection.height << "}"
+			   << "\n}\n";
+	}
+}
+
+// Writes any clip which is still recording its post-roll, then waits for all
+// pending clips to be written.
+void EventClipRecorder::Close()
+{
+	if (mActiveClip != NULL)
+		FinishActiveClip();
+	if (mWriterThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			mClosing = true;
+		}
+		mClipPending.notify_one();
+		mWriterThread.join();
+	}
+	mRingBuffer.clear();
+	mBufferBytes = 0;
+}
+
+size_t EventClipRecorder::getBufferBytes()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	return mBufferBytes + ((mActiveClip != NULL) ? mActiveClip->mBytes : 0) + mPendingBytes;
+}
+
+String EventClipRecorder::getString()
+{
+	size_t buffer_bytes = getBufferBytes();
+	std::lock_guard<std::mutex> lock(mLock);
+	std::ostringstream temp;
+	temp << "Event clips: " << mEventCount << " events, " << mClipsWritten << " written, "
+		 << mClipsDropped << " dropped, " << mFramesDropped << " frames dropped, "
+		 << buffer_bytes/1024 << " KB buffered";
+	return temp.str();
+}
@@ -0,0 +1,326 @@
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <iostream>
+#include <stdio.h>
+
+#include "Video.cpp"
+#include "ForegroundMask.cpp"
+#include "FrameBuffers.cpp"
+
+using namespace cv;
+using namespace std;
+
+#define FAST_AGING_RATE	1.009
+#define SLOW_AGING_RATE	1.005
+#define VALUES_PER_BIN	4
+#define DIFF_THRESH		50
+#define DISPLAY_FRAMES	40
+#define CHECKPOINT_FRAMES	750
+#define GATE_TILE_SIZE		16
+#define GATE_TOLERANCE		6
+#define GATE_MAXIMUM_DEFERRED	25
+
+
+// pad the extent of the foreground (inclusive coordinates) into the rectangle
+// reported as a detection
+CvRect padExtent(int startx, int starty, int endx, int endy, Size size) {
+	// add 10px padding on each side, if possible
+	if (startx >= 10)
+		startx -= 10;
+	if (starty >= 10)
+		starty -= 10;
+	if (endx <= size.width-10)
+		endx += 10;
+	if (endy <= size.height-10)
+		endy += 10;
+	
+	CvRect rect(startx, starty, endx-startx, endy-starty);
+	return rect;
+}
+
+CvRect cropBlackBorder(Mat img) {
+	int startx = -1, endx = -1, starty = -1, endy = -1;
+	for (int i = 0; i < img.cols; i++) {
+		for (int j = 0; j < img.rows; j++) {
+			uchar pval = img.at<uchar>(j,i);
+			if (pval > 0) {
+				if (startx == -1)
+					startx = i;
+				if (starty == -1 || starty > j)
+					starty = j;
+				if (j > endy)
+					endy = j;
+				if (i > endx)
+					endx = i;
+			}
+		}
+	}
+	return padExtent(startx, starty, endx, endy, img.size());
+}
+
+// remove noise that's not part of the bag. the morphology steps ping-pong
+// between the result and scratch buffers, since running them in place makes
+// opencv allocate a copy of the source every time
+void cleanNoise(Mat img, Mat& res, Mat& scratch) {
+	TRACE_SCOPE("cleanNoise");
+	erode(img, res, Mat());
+	erode(res, scratch, Mat());
+	dilate(scratch, res, Mat());
+}
+
+// Detects abandoned and removed objects. Two background models are kept which
+// age at different rates; an object which has recently appeared or disappeared
+// has been absorbed into the faster model but not yet into the slower one, so
+// it shows up where the two backgrounds differ. The models are median
+// backgrounds unless another backend is named (see CreateBackgroundModel).
+class AbandonmentDetector
+{
+private:
+	String mModelName;
+	Ptr<BackgroundModel> mBackground1;
+	Ptr<BackgroundModel> mBackground2;
+	FrameBufferPool mFramePool;
+	vector<uchar> mMaskLineBuffers;
+	Mat mMask;
+	Rect mRect;
+	Rect mFinalRect;
+	bool mRectValid;
+	bool mRectFinal;
+	int mFinalCount;
+	Timestamper* mTimer;
+	int mBackgroundEvent;
+	int mCheckpointEvent;
+	int mMaskEvent;
+	int mTrackingEvent;
+	Ptr<CheckpointWriter> mCheckpointWriter;
+	String mCheckpointPrefix;
+	int mCheckpointFrames;
+	int mFramesSinceCheckpoint;
+	int mGateTileSize;
+	int mGateMaximumDeferred;
+	void ApplyChangeGating( Ptr<BackgroundModel>& model );
+public:
+	AbandonmentDetector( Mat initial_frame, Timestamper* timer=NULL, String model_name="median" );
+	bool ProcessFrame( Mat frame );
+	bool RestoreCheckpoint( String prefix );
+	void EnableCheckpoints( String prefix, int frames_between_checkpoints=CHECKPOINT_FRAMES );
+	void SaveCheckpoint();
+	void EnableChangeGating( int tile_size=GATE_TILE_SIZE, int maximum_deferred_frames=GATE_MAXIMUM_DEFERRED );
+	// Fraction of the image updated in the background models
+	double getUpdatedFraction()
+	{
+		return (mBackground1->getUpdatedFraction() + mBackground2->getUpdatedFraction())/2.0;
+	}
+	Mat getMask()
+	{
+		return mMask;
+	}
+	Rect getDetection()
+	{
+		return mFinalRect;
+	}
+	FrameBufferPool& getFramePool()
+	{
+		return mFramePool;
+	}
+	// Bytes held by both background models
+	size_t getModelMemoryUsage()
+	{
+		return mBackground1->getMemoryUsage() + mBackground2->getMemoryUsage();
+	}
+};
+
+// 16 bit cameras have 256 times as many levels, so use proportionally wider
+// bins to keep the same number of histogram bins per pixel
+int getValuesPerBin( Mat frame )
+{
+	return (frame.depth() == CV_16U) ? VALUES_PER_BIN*256 : VALUES_PER_BIN;
+}
+
+AbandonmentDetector::AbandonmentDetector( Mat initial_frame, Timestamper* timer, String model_name )
+{
+	mModelName = model_name;
+	mBackground1 = CreateBackgroundModel( model_name, initial_frame, FAST_AGING_RATE, getValuesPerBin(initial_frame) );
+	mBackground2 = CreateBackgroundModel( model_name, initial_frame, SLOW_AGING_RATE, getValuesPerBin(initial_frame) );
+	CV_Assert( mBackground1 && mBackground2 );
+	mMask = Mat::zeros(initial_frame.size(), CV_8UC1);
+	mRectValid = false;
+	mRectFinal = false;
+	mFinalCount = 0;
+	mTimer = timer;
+	mCheckpointFrames = 0;
+	mFramesSinceCheckpoint = 0;
+	mGateTileSize = 0;
+	mGateMaximumDeferred = 0;
+	if (mTimer)
+	{
+		mBackgroundEvent = mTimer->registerEvent("Background");
+		mCheckpointEvent = mTimer->registerEvent("Checkpoint");
+		mMaskEvent = mTimer->registerEvent("Mask");
+		mTrackingEvent = mTimer->registerEvent("Tracking");
+	}
+}
+
+// Returns true while a detection should be shown (for DISPLAY_FRAMES frames
+// after the tracked rectangle stops growing)
+bool AbandonmentDetector::ProcessFrame( Mat frame )
+{
+	// update the median frames based on the current frame. the background
+	// images are views onto each model's own buffer, so they're only read
+	// after both updates have been applied
+	mBackground1->UpdateBackground(frame);
+	mBackground2->UpdateBackground(frame);
+	Mat mbframe1 = mBackground1->GetBackgroundImage();
+	Mat mbframe2 = mBackground2->GetBackgroundImage();
+	if (mTimer) mTimer->recordTime(mBackgroundEvent);
+	// checkpoints have an event of their own so that they don't show up in
+	// the background update latencies
+	if (mCheckpointFrames > 0 && ++mFramesSinceCheckpoint >= mCheckpointFrames)
+	{
+		SaveCheckpoint();
+		if (mTimer) mTimer->recordTime(mCheckpointEvent);
+	}
+	
+	int foreground_pixels = 0;
+	Rect newr;
+	if (frame.depth() == CV_8U) {
+		// the difference, threshold and noise cleaning are fused into one
+		// sweep which also finds the extent of the foreground
+		Rect extent;
+		foreground_pixels = computeForegroundMask(mbframe1, mbframe2, DIFF_THRESH, mMask, mMaskLineBuffers, &extent);
+		if (foreground_pixels > 0)
+			newr = padExtent(extent.x, extent.y, extent.x+extent.width-1, extent.y+extent.height-1, mMask.size());
+	} else {
+		// every per-frame intermediate is checked out of the pool, so there
+		// are no frame-sized allocations once the first frame has been
+		// processed
+		Mat diff = mFramePool.Acquire(frame.size(), frame.type());
+		Mat gray = mFramePool.Acquire(frame.size(), CV_MAKETYPE(frame.depth(), 1));
+		Mat tdiff = mFramePool.Acquire(frame.size(), CV_8UC1);
+		Mat scratch = mFramePool.Acquire(frame.size(), CV_8UC1);
+		
+		// get the absolute difference of the two different background models
+		absdiff(mbframe1, mbframe2, diff);
+		
+		// reduce the difference to a single 8 bit channel. 16 bit cameras are
+		// scaled down to 8 bits
+		Mat gray_diff = diff;
+		if (diff.channels() == 3) {
+			cvtColor(diff, gray, CV_BGR2GRAY);
+			gray_diff = gray;
+		}
+		gray_diff.convertTo(tdiff, CV_8U, 1.0/256.0);
+		threshold(tdiff, tdiff, DIFF_THRESH, 255, THRESH_BINARY);
+		
+		// try to clean some of the noise not related to the moving obejct
+		cleanNoise(tdiff, mMask, scratch);
+		mFramePool.Release(diff);
+		mFramePool.Release(gray);
+		mFramePool.Release(tdiff);
+		mFramePool.Release(scratch);
+		foreground_pixels = countNonZero(mMask);
+		if (foreground_pixels > 0)
+			newr = cropBlackBorder(mMask);
+	}
+	if (mTimer) mTimer->recordTime(mMaskEvent);
+	
+	if (foreground_pixels > 0) {
+		if (!mRectValid) {
+			// begin rectangle size tracking
+			mRectValid = true;
+			mRect = newr;
+		} else {
+			// keep growing the rectangle until it starts shrinking, then
+			// maintain the max size it held
+			if (newr.area() > mRect.area()) {
+				mRect = newr;
+			} else {
+				mFinalRect = mRect;
+				mRectFinal = true;
+			}
+		}
+	} else {
+		// reset rectangle size tracking
+		mRectValid = false;
+	}
+	
+	// keep reporting the tracked rectangle for DISPLAY_FRAMES frames
+	bool show_detection = false;
+	if (mRectFinal && mFinalCount < DISPLAY_FRAMES) {
+		show_detection = true;
+		mFinalCount++;
+	} else {
+		mRectFinal = false;
+		mFinalCount = 0;
+	}
+	if (mTimer) mTimer->recordTime(mTrackingEvent);
+	return show_detection;
+}
+
+// Each background model has its own checkpoint file, named from the prefix
+// with _fast.bgck and _slow.bgck
+bool AbandonmentDetector::RestoreCheckpoint( String prefix )
+{
+	// both models must be restored or neither, since a warm model compared
+	// with a cold one would differ everywhere. the checkpoints are loaded into
+	// new models which only replace the current ones once both have loaded
+	Mat background = mBackground1->GetBackgroundImage();
+	Ptr<BackgroundModel> restored1 = CreateBackgroundModel( mModelName, background, FAST_AGING_RATE, getValuesPerBin(background) );
+	Ptr<BackgroundModel> restored2 = CreateBackgroundModel( mModelName, background, SLOW_AGING_RATE, getValuesPerBin(background) );
+	if (!restored1->RestoreCheckpoint( prefix + "_fast.bgck" ) ||
+		!restored2->RestoreCheckpoint( prefix + "_slow.bgck" ))
+		return false;
+	ApplyChangeGating(restored1);
+	ApplyChangeGating(restored2);
+	mBackground1 = restored1;
+	mBackground2 = restored2;
+	return true;
+}
+
+// Saves the state of the background models every frames_between_checkpoints
+// frames. The states are copied on the calling thread but written to disk in
+// the background.
+void AbandonmentDetector::EnableCheckpoints( String prefix, int frames_between_checkpoints )
+{
+	mCheckpointPrefix = prefix;
+	mCheckpointFrames = frames_between_checkpoints;
+	mFramesSinceCheckpoint = 0;
+	if (!mCheckpointWriter)
+		mCheckpointWriter = Ptr<CheckpointWriter>( new CheckpointWriter() );
+}
+
+void AbandonmentDetector::SaveCheckpoint()
+{
+	if (!mCheckpointWriter)
+		return;
+	vector<uchar> state;
+	mBackground1->WriteState(state);
+	mCheckpointWriter->Submit(mCheckpointPrefix + "_fast.bgck", state);
+	mBackground2->WriteState(state);
+	mCheckpointWriter->Submit(mCheckpointPrefix + "_slow.bgck", state);
+	mFramesSinceCheckpoint = 0;
+}
+
+// Only update the parts of the background models which are changing (for the
+// backends which support it). Tiles of tile_size pixels which stay within
+// GATE_TOLERANCE grey levels (scaled for 16 bit cameras) of the last frame
+// applied have their updates deferred for up to maximum_deferred_frames frames.
+void AbandonmentDetector::EnableChangeGating( int tile_size, int maximum_deferred_frames )
+{
+	mGateTileSize = tile_size;
+	mGateMaximumDeferred = maximum_deferred_frames;
+	ApplyChangeGating(mBackground1);
+	ApplyChangeGating(mBackground2);
+}
+
+void AbandonmentDetector::ApplyChangeGating( Ptr<BackgroundModel>& model )
+{
+	if (mGateTileSize <= 0)
+		return;
+	Mat background = model->GetBackgroundImage();
+	int tolerance = (background.depth() == CV_16U) ? GATE_TOLERANCE*256 : GATE_TOLERANCE;
+	if (!model->EnableChangeGating( mGateTileSize, tolerance, mGateMaximumDeferred ))
+		cout << "The " << model->getName() << " background model does not support change gating" << endl;
+}
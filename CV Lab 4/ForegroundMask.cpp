@@ -0,0 +1,194 @@
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+
+#include "../CV Common/Utilities.h"
+
+#if CV_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace cv;
+using namespace std;
+
+// fixed point BGR to grey weights, as used by opencv's cvtColor for 8 bit
+// images, so the fused mask matches the separate steps exactly
+#define GRAY_SHIFT	14
+#define GRAY_B		1868
+#define GRAY_G		9617
+#define GRAY_R		4899
+
+// out[x] = min(a[x], b[x], c[x])
+static void minOfRows(const uchar* a, const uchar* b, const uchar* c, uchar* out, int n) {
+	int x = 0;
+#if CV_SSE2
+	for (; x <= n-16; x += 16) {
+		__m128i v = _mm_min_epu8(_mm_loadu_si128((const __m128i*)(a+x)), _mm_loadu_si128((const __m128i*)(b+x)));
+		_mm_storeu_si128((__m128i*)(out+x), _mm_min_epu8(v, _mm_loadu_si128((const __m128i*)(c+x))));
+	}
+#endif
+	for (; x < n; x++)
+		out[x] = std::min(std::min(a[x], b[x]), c[x]);
+}
+
+// out[x] = max(a[x], b[x], c[x])
+static void maxOfRows(const uchar* a, const uchar* b, const uchar* c, uchar* out, int n) {
+	int x = 0;
+#if CV_SSE2
+	for (; x <= n-16; x += 16) {
+		__m128i v = _mm_max_epu8(_mm_loadu_si128((const __m128i*)(a+x)), _mm_loadu_si128((const __m128i*)(b+x)));
+		_mm_storeu_si128((__m128i*)(out+x), _mm_max_epu8(v, _mm_loadu_si128((const __m128i*)(c+x))));
+	}
+#endif
+	for (; x < n; x++)
+		out[x] = std::max(std::max(a[x], b[x]), c[x]);
+}
+
+/**
+ * Erode (or dilate) one row of a 3x3 rectangle in two 1D passes: the minimum
+ * (maximum) down the three rows and then across each group of three columns.
+ * The rows are padded with one value at each end which stands in for the
+ * pixels outside the image.
+ * @param above padded row above (or a border row)
+ * @param row padded row being filtered
+ * @param below padded row below (or a border row)
+ * @param column_extremes padded scratch row
+ * @param out unpadded output row
+ * @param cols number of pixels in the row
+ * @param is_erosion true for the minimum, false for the maximum
+ */
+static void morphologyRow(const uchar* above, const uchar* row, const uchar* below,
+						  uchar* column_extremes, uchar* out, int cols, bool is_erosion) {
+	if (is_erosion) {
+		minOfRows(above, row, below, column_extremes, cols+2);
+		minOfRows(column_extremes, column_extremes+1, column_extremes+2, out, cols);
+	} else {
+		maxOfRows(above, row, below, column_extremes, cols+2);
+		maxOfRows(column_extremes, column_extremes+1, column_extremes+2, out, cols);
+	}
+}
+
+/**
+ * Threshold the grey level of the absolute difference of one row of the two
+ * backgrounds.
+ * @param row1 row of the first background
+ * @param row2 row of the second background
+ * @param difference scratch row of cols*channels values
+ * @param out output row, 255 where the grey difference is above thresh
+ * @param cols number of pixels in the row
+ * @param channels 1 (grey) or 3 (BGR)
+ * @param thresh threshold on the grey difference
+ */
+static void thresholdDifferenceRow(const uchar* row1, const uchar* row2, uchar* difference, uchar* out,
+								   int cols, int channels, int thresh) {
+	int n = cols*channels;
+	int x = 0;
+#if CV_SSE2
+	// |a-b| is whichever of the saturated differences isn't zero
+	for (; x <= n-16; x += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(row1+x));
+		__m128i b = _mm_loadu_si128((const __m128i*)(row2+x));
+		_mm_storeu_si128((__m128i*)(difference+x), _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a)));
+	}
+#endif
+	for (; x < n; x++)
+		difference[x] = (uchar) std::abs(row1[x] - row2[x]);
+
+	if (channels == 1) {
+		for (x = 0; x < cols; x++)
+			out[x] = (difference[x] > thresh) ? 255 : 0;
+	} else {
+		// compare the weighted sum directly rather than rounding it to a grey
+		// level: ((sum + half) >> shift) > thresh  <=>  sum >= limit
+		int limit = ((thresh+1) << GRAY_SHIFT) - (1 << (GRAY_SHIFT-1));
+		for (x = 0; x < cols; x++, difference += 3) {
+			int sum = difference[0]*GRAY_B + difference[1]*GRAY_G + difference[2]*GRAY_R;
+			out[x] = (sum >= limit) ? 255 : 0;
+		}
+	}
+}
+
+/**
+ * Compute the cleaned foreground mask of two 8 bit backgrounds in one sweep.
+ * This gives the same mask as absdiff, cvtColor to grey, threshold, and
+ * then erode, erode and dilate with 3x3 rectangles (as in cleanNoise), but
+ * each row goes through all of the steps while it is still in a small ring of
+ * line buffers, so no intermediate images are written.
+ * @param background1 first background (CV_8UC1 or CV_8UC3)
+ * @param background2 second background, the same size and type
+ * @param thresh threshold on the grey difference
+ * @param mask output CV_8UC1 mask, 255 for foreground
+ * @param line_buffers storage for the line buffers, reused between calls
+ * @param extent if not NULL, set to the bounding box of the foreground
+ * @return number of foreground pixels in the mask
+ */
+int computeForegroundMask(Mat& background1, Mat& background2, int thresh, Mat& mask,
+						  vector<uchar>& line_buffers, Rect* extent = NULL) {
+	TRACE_SCOPE("computeForegroundMask");
+	CV_Assert(background1.type() == background2.type() && background1.size() == background2.size());
+	CV_Assert(background1.type() == CV_8UC1 || background1.type() == CV_8UC3);
+	int rows = background1.rows, cols = background1.cols, channels = background1.channels();
+	mask.create(background1.size(), CV_8UC1);
+
+	// each padded row has one extra value at either end. thresholded and
+	// once-eroded rows are padded with 255 so that the border never erodes
+	// anything, and twice-eroded rows with 0 so that it never dilates anything
+	int padded = cols+2;
+	line_buffers.resize(12*padded + cols*channels);
+	uchar* buffer = &line_buffers[0];
+	uchar* thresholded[3] = { buffer, buffer+padded, buffer+2*padded };
+	uchar* eroded[3] = { buffer+3*padded, buffer+4*padded, buffer+5*padded };
+	uchar* eroded_twice[3] = { buffer+6*padded, buffer+7*padded, buffer+8*padded };
+	uchar* erosion_border = buffer+9*padded;
+	uchar* dilation_border = buffer+10*padded;
+	uchar* column_extremes = buffer+11*padded;
+	uchar* difference = buffer+12*padded;
+	memset(buffer, 255, 6*padded);
+	memset(buffer+6*padded, 0, 3*padded);
+	memset(erosion_border, 255, padded);
+	memset(dilation_border, 0, padded);
+
+	int count = 0;
+	int startx = cols, starty = rows, endx = -1, endy = -1;
+	// step i thresholds row i, erodes row i-1, erodes row i-2 again and
+	// dilates row i-3, each of which only needs the rows on either side of it
+	// from the step before
+	for (int i = 0; i < rows+3; i++) {
+		if (i < rows)
+			thresholdDifferenceRow(background1.ptr(i), background2.ptr(i), difference,
+								   thresholded[i%3]+1, cols, channels, thresh);
+		int row = i-1;
+		if (row >= 0 && row < rows)
+			morphologyRow((row > 0) ? thresholded[(row-1)%3] : erosion_border, thresholded[row%3],
+						  (row+1 < rows) ? thresholded[(row+1)%3] : erosion_border,
+						  column_extremes, eroded[row%3]+1, cols, true);
+		row = i-2;
+		if (row >= 0 && row < rows)
+			morphologyRow((row > 0) ? eroded[(row-1)%3] : erosion_border, eroded[row%3],
+						  (row+1 < rows) ? eroded[(row+1)%3] : erosion_border,
+						  column_extremes, eroded_twice[row%3]+1, cols, true);
+		row = i-3;
+		if (row >= 0) {
+			uchar* out = mask.ptr(row);
+			morphologyRow((row > 0) ? eroded_twice[(row-1)%3] : dilation_border, eroded_twice[row%3],
+						  (row+1 < rows) ? eroded_twice[(row+1)%3] : dilation_border,
+						  column_extremes, out, cols, false);
+			// the count and extent are taken from the finished row while it
+			// is still in the cache
+			for (int x = 0; x < cols; x++) {
+				if (out[x]) {
+					count++;
+					startx = std::min(startx, x);
+					endx = std::max(endx, x);
+					starty = std::min(starty, row);
+					endy = row;
+				}
+			}
+		}
+	}
+	if (extent != NULL)
+		*extent = (count > 0) ? Rect(startx, starty, endx-startx+1, endy-starty+1) : Rect();
+	return count;
+}
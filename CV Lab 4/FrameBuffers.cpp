@@ -0,0 +1,280 @@
+#include <opencv2/highgui/highgui.hpp>
+
+#include <iostream>
+#include <stdio.h>
+
+#include "../CV Common/Utilities.h"
+
+using namespace cv;
+using namespace std;
+
+// Recycles frame-sized Mats so that a per-frame pipeline stops allocating once
+// it has reached steady state.  Buffers are matched on size and type; a miss
+// allocates a new buffer which joins the pool when it is released.  Buffers
+// may be acquired on one thread and released on another.
+class FrameBufferPool {
+private:
+	vector<Mat> mFreeBuffers;
+	int mHits;
+	int mMisses;
+	int mBuffersInUse;
+	std::mutex mLock;
+public:
+	FrameBufferPool();
+	Mat Acquire( Size size, int type );
+	void Release( Mat& buffer );
+	void Clear();
+	int getHits();
+	int getMisses();
+	int getBuffersInUse();
+	String getString();
+};
+
+// Writes video frames on a dedicated encoder thread so that a slow encode does
+// not stall the caller.  Each frame is copied into a pooled buffer and queued;
+// when the queue is full the frame is either dropped or the caller waits for
+// the encoder, depending on the policy.  Close() writes out all queued frames.
+#define ASYNC_WRITER_DROP 0
+#define ASYNC_WRITER_BLOCK 1
+class AsyncVideoWriter {
+private:
+	VideoWriter mWriter;
+	FrameBufferPool mFramePool;
+	deque<Mat> mQueue;
+	int mMaximumQueueLength;
+	int mPolicy;
+	int mFramesBeingCopied;
+	bool mClosing;
+	int mFramesQueued;
+	int mFramesWritten;
+	int mFramesDropped;
+	int mTimesBlocked;
+	int mPeakQueueLength;
+	std::mutex mLock;
+	std::condition_variable mFrameQueued;
+	std::condition_variable mFrameTaken;
+	std::thread mEncoder;
+	void EncodeFrames();
+public:
+	AsyncVideoWriter();
+	~AsyncVideoWriter();
+	bool Open( String filename, int codec, Size frame_size, double fps, int maximum_queue_length=16, int policy=ASYNC_WRITER_BLOCK );
+	bool Open( String filename, VideoCapture& video_to_emulate, int maximum_queue_length=16, int policy=ASYNC_WRITER_BLOCK );
+	bool isOpened();
+	bool Write( Mat& frame );
+	void Close();
+	int getFramesQueued();
+	int getFramesWritten();
+	int getFramesDropped();
+	int getTimesBlocked();
+	int getPeakQueueLength();
+	String getString();
+};
+
+FrameBufferPool::FrameBufferPool()
+{
+	mHits = 0;
+	mMisses = 0;
+	mBuffersInUse = 0;
+}
+Mat FrameBufferPool::Acquire( Size size, int type )
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	mBuffersInUse++;
+	for (int buffer=0; buffer < (int) mFreeBuffers.size(); buffer++)
+	{
+		if ((mFreeBuffers[buffer].size() == size) && (mFreeBuffers[buffer].type() == type))
+		{
+			Mat result = mFreeBuffers[buffer];
+			mFreeBuffers[buffer] = mFreeBuffers.back();
+			mFreeBuffers.pop_back();
+			mHits++;
+			return result;
+		}
+	}
+	mMisses++;
+	return Mat( size, type );
+}
+void FrameBufferPool::Release( Mat& buffer )
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	// Views into other images (ROIs) are not whole buffers so they are not kept
+	if (!buffer.empty() && !buffer.isSubmatrix())
+		mFreeBuffers.push_back( buffer );
+	buffer.release();
+	if (mBuffersInUse > 0)
+		mBuffersInUse--;
+}
+void FrameBufferPool::Clear()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	mFreeBuffers.clear();
+}
+int FrameBufferPool::getHits()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	return mHits;
+}
+int FrameBufferPool::getMisses()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	return mMisses;
+}
+int FrameBufferPool::getBuffersInUse()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	return mBuffersInUse;
+}
+String FrameBufferPool::getString()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	std::ostringstream temp;
+	temp << "Frame buffers: " << mHits << " hits, " << mMisses << " misses, "
+		 << mBuffersInUse << " in use, " << mFreeBuffers.size() << " free";
+	return temp.str();
+}
+
+
+AsyncVideoWriter::AsyncVideoWriter()
+{
+	mMaximumQueueLength = 16;
+	mPolicy = ASYNC_WRITER_BLOCK;
+	mFramesBeingCopied = 0;
+	mClosing = false;
+	mFramesQueued = 0;
+	mFramesWritten = 0;
+	mFramesDropped = 0;
+	mTimesBlocked = 0;
+	mPeakQueueLength = 0;
+}
+AsyncVideoWriter::~AsyncVideoWriter()
+{
+	Close();
+}
+bool AsyncVideoWriter::Open( String filename, int codec, Size frame_size, double fps, int maximum_queue_length, int policy )
+{
+	Close();
+	mWriter.open(filename, codec, fps, frame_size, true);
+	if (!mWriter.isOpened())
+	{
+		cout << "Could not open the output video for write: " << filename << endl;
+		return false;
+	}
+	mMaximumQueueLength = std::max(1, maximum_queue_length);
+	mPolicy = policy;
+	mClosing = false;
+	mEncoder = std::thread(&AsyncVideoWriter::EncodeFrames, this);
+	return true;
+}
+bool AsyncVideoWriter::Open( String filename, VideoCapture& video_to_emulate, int maximum_queue_length, int policy )
+{
+	int codec = static_cast<int>(video_to_emulate.get(CV_CAP_PROP_FOURCC));
+	Size frame_size = Size((int) video_to_emulate.get(CV_CAP_PROP_FRAME_WIDTH),
+                           (int) video_to_emulate.get(CV_CAP_PROP_FRAME_HEIGHT));
+	double fps = video_to_emulate.get(CV_CAP_PROP_FPS);
+	return Open( filename, codec, frame_size, fps, maximum_queue_length, policy );
+}
+bool AsyncVideoWriter::isOpened()
+{
+	return mEncoder.joinable();
+}
+// Returns false if the frame was dropped (or the writer is not open).
+bool AsyncVideoWriter::Write( Mat& frame )
+{
+	if (!isOpened())
+		return false;
+	{
+		// A slot is reserved before copying so that concurrent writers cannot
+		// overfill the queue while their copies are in progress
+		std::unique_lock<std::mutex> lock(mLock);
+		if ((int) mQueue.size() + mFramesBeingCopied >= mMaximumQueueLength)
+		{
+			if (mPolicy == ASYNC_WRITER_DROP)
+			{
+				mFramesDropped++;
+				return false;
+			}
+			mTimesBlocked++;
+			mFrameTaken.wait(lock, [this] { return (int) mQueue.size() + mFramesBeingCopied < mMaximumQueueLength; });
+		}
+		mFramesBeingCopied++;
+	}
+	Mat copy = mFramePool.Acquire(frame.size(), frame.type());
+	frame.copyTo(copy);
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		mFramesBeingCopied--;
+		mQueue.push_back(copy);
+		mFramesQueued++;
+		mPeakQueueLength = std::max(mPeakQueueLength, (int) mQueue.size());
+	}
+	mFrameQueued.notify_one();
+	return true;
+}
+void AsyncVideoWriter::EncodeFrames()
+{
+	for (;;)
+	{
+		Mat frame;
+		{
+			std::unique_lock<std::mutex> lock(mLock);
+			mFrameQueued.wait(lock, [this] { return !mQueue.empty() || mClosing; });
+			if (mQueue.empty())
+				return;
+			frame = mQueue.front();
+			mQueue.pop_front();
+		}
+		mFrameTaken.notify_all();
+		mWriter.write(frame);
+		mFramePool.Release(frame);
+		std::lock_guard<std::mutex> lock(mLock);
+		mFramesWritten++;
+	}
+}
+void AsyncVideoWriter::Close()
+{
+	if (mEncoder.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			mClosing = true;
+		}
+		mFrameQueued.notify_one();
+		mEncoder.join();
+	}
+	mWriter.release();
+	mFramePool.Clear();
+}
+int AsyncVideoWriter::getFramesQueued()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	return mFramesQueued;
+}
+int AsyncVideoWriter::getFramesWritten()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	return mFramesWritten;
+}
+int AsyncVideoWriter::getFramesDropped()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	return mFramesDropped;
+}
+int AsyncVideoWriter::getTimesBlocked()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	return mTimesBlocked;
+}
+int AsyncVideoWriter::getPeakQueueLength()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	return mPeakQueueLength;
+}
+String AsyncVideoWriter::getString()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	std::ostringstream temp;
+	temp << "Video frames: " << mFramesWritten << " written, " << mFramesDropped << " dropped, "
+		 << mTimesBlocked << " waits, peak queue " << mPeakQueueLength << "/" << mMaximumQueueLength;
+	return temp.str();
+}
@@ -0,0 +1,314 @@
+#include <opencv2/highgui/highgui.hpp>
+
+#include <iostream>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../CV Common/Utilities.h"
+
+using namespace cv;
+using namespace std;
+
+// A raw frame file is a header followed by decoded frames at a fixed stride,
+// so that it can be memory mapped and each frame used in place.  The frames
+// start one page into the file and each is padded to a multiple of
+// RAW_FRAME_ALIGNMENT bytes so that every frame starts on a cache line.
+#define RAW_FRAME_MAGIC		0x57415246
+#define RAW_FRAME_VERSION	1
+#define RAW_FRAME_DATA_OFFSET	4096
+#define RAW_FRAME_ALIGNMENT	64
+
+struct RawFrameHeader {
+	uint32_t mMagic;
+	uint32_t mVersion;
+	int32_t mWidth;
+	int32_t mHeight;
+	int32_t mType;
+	int32_t mFourCC;
+	double mFPS;
+	uint64_t mFrameBytes;
+	uint64_t mFrameStride;
+	uint64_t mFrameCount;
+	uint64_t mDataOffset;
+};
+
+// Records decoded frames into a raw frame file.  Every frame must have the
+// size and type of the first.  The frame count in the header is only filled
+// in by Close, but readers work out the number of frames from the length of
+// the file, so a recording which was cut short can still be replayed.
+class RawFrameWriter
+{
+private:
+	FILE* mFile;
+	RawFrameHeader mHeader;
+	vector<uchar> mPadding;
+public:
+	RawFrameWriter();
+	~RawFrameWriter();
+	bool Open( String filename, Size frame_size, int type, double fps, int fourcc=0 );
+	bool Write( Mat& frame );
+	void Close();
+	bool isOpened()
+	{
+		return mFile != NULL;
+	}
+	int getFrameCount()
+	{
+		return (int) mHeader.mFrameCount;
+	}
+};
+
+RawFrameWriter::RawFrameWriter()
+{
+	mFile = NULL;
+	memset(&mHeader, 0, sizeof(mHeader));
+}
+
+RawFrameWriter::~RawFrameWriter()
+{
+	Close();
+}
+
+bool RawFrameWriter::Open( String filename, Size frame_size, int type, double fps, int fourcc )
+{
+	Close();
+	mFile = fopen(filename.c_str(), "wb");
+	if (mFile == NULL)
+	{
+		cout << "Could not open the raw frame file for write: " << filename << endl;
+		return false;
+	}
+	memset(&mHeader, 0, sizeof(mHeader));
+	mHeader.mMagic = RAW_FRAME_MAGIC;
+	mHeader.mVersion = RAW_FRAME_VERSION;
+	mHeader.mWidth = frame_size.width;
+	mHeader.mHeight = frame_size.height;
+	mHeader.mType = type;
+	mHeader.mFourCC = fourcc;
+	mHeader.mFPS = fps;
+	mHeader.mFrameBytes = (uint64_t) frame_size.area()*CV_ELEM_SIZE(type);
+	mHeader.mFrameStride = (mHeader.mFrameBytes + RAW_FRAME_ALIGNMENT-1)/RAW_FRAME_ALIGNMENT*RAW_FRAME_ALIGNMENT;
+	mHeader.mDataOffset = RAW_FRAME_DATA_OFFSET;
+	mPadding.assign(RAW_FRAME_DATA_OFFSET, 0);
+	memcpy(&mPadding[0], &mHeader, sizeof(mHeader));
+	if (fwrite(&mPadding[0], 1, RAW_FRAME_DATA_OFFSET, mFile) != RAW_FRAME_DATA_OFFSET)
+	{
+		cout << "Could not write the raw frame header: " << filename << endl;
+		Close();
+		return false;
+	}
+	mPadding.assign((size_t) (mHeader.mFrameStride-mHeader.mFrameBytes), 0);
+	return true;
+}
+
+bool RawFrameWriter::Write( Mat& frame )
+{
+	if (!isOpened())
+		return false;
+	CV_Assert((frame.cols == mHeader.mWidth) && (frame.rows == mHeader.mHeight) && (frame.type() == mHeader.mType));
+	size_t row_bytes = frame.cols*frame.elemSize();
+	bool written = true;
+	if (frame.isContinuous())
+		written = (fwrite(frame.data, 1, (size_t) mHeader.mFrameBytes, mFile) == mHeader.mFrameBytes);
+	else for (int row=0; written && (row < frame.rows); row++)
+		written = (fwrite(frame.ptr(row), 1, row_bytes, mFile) == row_bytes);
+	if (written && !mPadding.empty())
+		written = (fwrite(&mPadding[0], 1, mPadding.size(), mFile) == mPadding.size());
+	if (!written)
+	{
+		cout << "Could not write frame " << mHeader.mFrameCount << " to the raw frame file" << endl;
+		return false;
+	}
+	mHeader.mFrameCount++;
+	return true;
+}
+
+// Rewrites the header with the final frame count and closes the file
+void RawFrameWriter::Close()
+{
+	if (mFile == NULL)
+		return;
+	fseek(mFile, 0, SEEK_SET);
+	fwrite(&mHeader, sizeof(mHeader), 1, mFile);
+	fclose(mFile);
+	mFile = NULL;
+}
+
+// A source of frames which is either anything VideoCapture can open or a raw
+// frame file.  Raw frame files are memory mapped read only, and each frame
+// read from one is a Mat header onto the mapping rather than a copy, so no
+// decoding or copying is done per frame.  Those frames must not be written
+// to (the process will fault if they are); clone them first if they are to be
+// drawn on.  A frame from a raw file stays valid until the source is released.
+class FrameSource
+{
+private:
+	VideoCapture mCapture;
+	int mFile;
+	uchar* mMapping;
+	size_t mMappingBytes;
+	RawFrameHeader mHeader;
+	int mNextFrame;
+	int mNumberOfFrames;
+	bool OpenRawFrames( String filename );
+public:
+	FrameSource();
+	FrameSource( String filename );
+	~FrameSource();
+	bool open( String filename );
+	bool read( Mat& frame );
+	void release();
+	bool isOpened()
+	{
+		return (mMapping != NULL) || mCapture.isOpened();
+	}
+	// True if the frames read are views onto a read only mapping
+	bool isZeroCopy()
+	{
+		return mMapping != NULL;
+	}
+	double getFPS();
+	int getFourCC();
+	Size getFrameSize();
+	// The number of frames in a raw frame file, or as reported by the video
+	int getNumberOfFrames();
+};
+
+FrameSource::FrameSource()
+{
+	mFile = -1;
+	mMapping = NULL;
+	mMappingBytes = 0;
+	mNextFrame = mNumberOfFrames = 0;
+	memset(&mHeader, 0, sizeof(mHeader));
+}
+
+FrameSource::FrameSource( String filename )
+{
+	mFile = -1;
+	mMapping = NULL;
+	mMappingBytes = 0;
+	mNextFrame = mNumberOfFrames = 0;
+	memset(&mHeader, 0, sizeof(mHeader));
+	open(filename);
+}
+
+FrameSource::~FrameSource()
+{
+	release();
+}
+
+// Files which start with the raw frame magic number are mapped, and anything
+// else is passed to VideoCapture
+bool FrameSource::open( String filename )
+{
+	release();
+	uint32_t magic = 0;
+	FILE* file = fopen(filename.c_str(), "rb");
+	if (file != NULL)
+	{
+		if (fread(&magic, sizeof(magic), 1, file) != 1)
+			magic = 0;
+		fclose(file);
+	}
+	if (magic == RAW_FRAME_MAGIC)
+		return OpenRawFrames(filename);
+	return mCapture.open(filename);
+}
+
+bool FrameSource::OpenRawFrames( String filename )
+{
+	mFile = ::open(filename.c_str(), O_RDONLY);
+	struct stat status;
+	if ((mFile < 0) || (fstat(mFile, &status) != 0) || (status.st_size < (off_t) sizeof(mHeader)) ||
+		(pread(mFile, &mHeader, sizeof(mHeader), 0) != (ssize_t) sizeof(mHeader)))
+	{
+		cout << "Could not read the raw frame file: " << filename << endl;
+		release();
+		return false;
+	}
+	if ((mHeader.mVersion != RAW_FRAME_VERSION) || (mHeader.mWidth <= 0) || (mHeader.mHeight <= 0) ||
+		(mHeader.mFrameBytes != (uint64_t) mHeader.mWidth*mHeader.mHeight*CV_ELEM_SIZE(mHeader.mType)) ||
+		(mHeader.mFrameStride < mHeader.mFrameBytes) || (mHeader.mDataOffset < sizeof(mHeader)))
+	{
+		cout << "Unsupported raw frame file: " << filename << endl;
+		release();
+		return false;
+	}
+	// a recording which wasn't closed has a count of zero, and one which
+	// was cut short has fewer frames than its header claims
+	uint64_t frames_in_file = ((uint64_t) status.st_size > mHeader.mDataOffset) ?
+		((uint64_t) status.st_size-mHeader.mDataOffset)/mHeader.mFrameStride : 0;
+	mNumberOfFrames = (int) (((mHeader.mFrameCount > 0) && (mHeader.mFrameCount < frames_in_file)) ?
+		mHeader.mFrameCount : frames_in_file);
+	mMappingBytes = (size_t) status.st_size;
+	void* mapping = mmap(NULL, mMappingBytes, PROT_READ, MAP_SHARED, mFile, 0);
+	if (mapping == MAP_FAILED)
+	{
+		cout << "Could not map the raw frame file: " << filename << endl;
+		release();
+		return false;
+	}
+	mMapping = (uchar*) mapping;
+	madvise(mMapping, mMappingBytes, MADV_SEQUENTIAL);
+	mNextFrame = 0;
+	return true;
+}
+
+// Frames from a raw frame file are touched once a page as they are read, so
+// that any page faults are counted as reading the frame rather than as part of
+// whatever processes it first
+bool FrameSource::read( Mat& frame )
+{
+	if (mMapping == NULL)
+		return mCapture.read(frame);
+	if (mNextFrame >= mNumberOfFrames)
+		return false;
+	uchar* data = mMapping + mHeader.mDataOffset + mHeader.mFrameStride*(uint64_t) mNextFrame;
+	mNextFrame++;
+	volatile uchar touched = 0;
+	for (uint64_t offset=0; offset < mHeader.mFrameBytes; offset += RAW_FRAME_DATA_OFFSET)
+		touched += data[offset];
+	frame = Mat(mHeader.mHeight, mHeader.mWidth, mHeader.mType, data);
+	return true;
+}
+
+void FrameSource::release()
+{
+	mCapture.release();
+	if (mMapping != NULL)
+		munmap(mMapping, mMappingBytes);
+	if (mFile >= 0)
+		close(mFile);
+	mFile = -1;
+	mMapping = NULL;
+	mMappingBytes = 0;
+	mNextFrame = mNumberOfFrames = 0;
+}
+
+double FrameSource::getFPS()
+{
+	return (mMapping != NULL) ? mHeader.mFPS : mCapture.get(CV_CAP_PROP_FPS);
+}
+
+int FrameSource::getFourCC()
+{
+	return (mMapping != NULL) ? mHeader.mFourCC : static_cast<int>(mCapture.get(CV_CAP_PROP_FOURCC));
+}
+
+Size FrameSource::getFrameSize()
+{
+	if (mMapping != NULL)
+		return Size(mHeader.mWidth, mHeader.mHeight);
+	return Size((int) mCapture.get(CV_CAP_PROP_FRAME_WIDTH), (int) mCapture.get(CV_CAP_PROP_FRAME_HEIGHT));
+}
+
+int FrameSource::getNumberOfFrames()
+{
+	return (mMapping != NULL) ? mNumberOfFrames : (int) mCapture.get(CV_CAP_PROP_FRAME_COUNT);
+}
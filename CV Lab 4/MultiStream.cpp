@@ -0,0 +1,188 @@
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <stdio.h>
+
+#include "Detector.cpp"
+#include "Scheduler.cpp"
+#include "FrameSource.cpp"
+
+using namespace cv;
+using namespace std;
+
+/**
+ * Read a list of video sources, one per line. Blank lines and lines starting
+ * with '#' are skipped.
+ * @param filename the list file
+ * @return the sources in the order listed
+ */
+vector<String> readSourceList(String filename) {
+	vector<String> sources;
+	ifstream list(filename.c_str());
+	if (!list.is_open()) {
+		cout << "Could not open the source list: " << filename << endl;
+		return sources;
+	}
+	string line;
+	while (getline(list, line)) {
+		// strip trailing whitespace (including the \r of windows line endings)
+		size_t end = line.find_last_not_of(" \t\r\n");
+		if (end == string::npos || line[0] == '#')
+			continue;
+		sources.push_back(line.substr(0, end+1));
+	}
+	return sources;
+}
+
+struct CameraStream {
+	String mSource;
+	FrameSource mCapture;
+	AbandonmentDetector* mDetector;
+	Mat mFrame;
+	int mFrames;
+	int mDetections;
+	bool mDetecting;
+	bool mFinished;
+	int64 mBusyTicks;
+	int64 mStartTicks;
+	int64 mEndTicks;
+};
+
+// Runs an abandonment detector on each of a number of video sources (videos
+// or raw frame files) in one process.  Every stream has its own background models; the per-frame work of
+// all of the streams is shared out over one WorkStealingPool.  Each stream has
+// a single task in the pool at any time, which reads and processes one frame
+// and then resubmits itself to the back of the queue, so the frames of a
+// stream are processed in order, the streams take turns, and no stream reads
+// ahead of the processing.
+class MultiStreamRunner
+{
+private:
+	vector<CameraStream*> mStreams;
+	WorkStealingPool mPool;
+	int mMaximumFrames;
+	String mModelName;
+	bool mGate;
+	int64 mStartTicks;
+	int64 mEndTicks;
+	void ProcessNextFrame( CameraStream* stream );
+public:
+	MultiStreamRunner( vector<String>& sources, int number_of_workers=0, int maximum_frames=0, String model_name="median", bool gate=false );
+	~MultiStreamRunner();
+	void Run();
+	void writeResults( ostream& output );
+	bool exportResults( String filename );
+};
+
+MultiStreamRunner::MultiStreamRunner( vector<String>& sources, int number_of_workers, int maximum_frames, String model_name, bool gate ) :
+	mPool( number_of_workers )
+{
+	mMaximumFrames = maximum_frames;
+	mModelName = model_name;
+	mGate = gate;
+	mStartTicks = mEndTicks = 0;
+	for (int source=0; source < (int) sources.size(); source++)
+	{
+		CameraStream* stream = new CameraStream();
+		stream->mSource = sources[source];
+		stream->mDetector = NULL;
+		stream->mFrames = 0;
+		stream->mDetections = 0;
+		stream->mDetecting = false;
+		stream->mFinished = true;
+		stream->mBusyTicks = stream->mStartTicks = stream->mEndTicks = 0;
+		// the first frame initialises the background models
+		if (!stream->mCapture.open(stream->mSource) || !stream->mCapture.read(stream->mFrame))
+			cout << "Could not open the video source: " << stream->mSource << endl;
+		else
+		{
+			stream->mDetector = new AbandonmentDetector(stream->mFrame, NULL, mModelName);
+			if (mGate)
+				stream->mDetector->EnableChangeGating();
+			stream->mFinished = false;
+		}
+		mStreams.push_back(stream);
+	}
+}
+
+MultiStreamRunner::~MultiStreamRunner()
+{
+	mPool.WaitUntilIdle();
+	for (int stream=0; stream < (int) mStreams.size(); stream++)
+	{
+		delete mStreams[stream]->mDetector;
+		delete mStreams[stream];
+	}
+}
+
+void MultiStreamRunner::ProcessNextFrame( CameraStream* stream )
+{
+	TRACE_SCOPE("MultiStreamRunner::ProcessNextFrame");
+	int64 start_ticks = getTickCount();
+	if (((mMaximumFrames > 0) && (stream->mFrames >= mMaximumFrames)) ||
+		!stream->mCapture.read(stream->mFrame))
+	{
+		stream->mFinished = true;
+		stream->mEndTicks = start_ticks;
+		// release the decoder now rather than when every stream has finished
+		stream->mCapture.release();
+		return;
+	}
+	bool detecting = stream->mDetector->ProcessFrame(stream->mFrame);
+	if (detecting && !stream->mDetecting)
+		stream->mDetections++;
+	stream->mDetecting = detecting;
+	stream->mFrames++;
+	stream->mBusyTicks += getTickCount()-start_ticks;
+	mPool.Submit([this, stream] { ProcessNextFrame(stream); });
+}
+
+void MultiStreamRunner::Run()
+{
+	mStartTicks = getTickCount();
+	for (int stream=0; stream < (int) mStreams.size(); stream++)
+		if (!mStreams[stream]->mFinished)
+		{
+			mStreams[stream]->mStartTicks = mStartTicks;
+			CameraStream* camera_stream = mStreams[stream];
+			mPool.Submit([this, camera_stream] { ProcessNextFrame(camera_stream); });
+		}
+	mPool.WaitUntilIdle();
+	mEndTicks = getTickCount();
+}
+
+// Frame rates are over each stream's own elapsed time, and the processing
+// time is the average time spent on one of its frames
+void MultiStreamRunner::writeResults( ostream& output )
+{
+	double tick_frequency = getTickFrequency();
+	output << "source,frames,fps,processing_ms,detections" << endl;
+	int total_frames = 0;
+	for (int index=0; index < (int) mStreams.size(); index++)
+	{
+		CameraStream* stream = mStreams[index];
+		double elapsed = ((double) (stream->mEndTicks-stream->mStartTicks))/tick_frequency;
+		output << "\"" << stream->mSource << "\"," << stream->mFrames << ","
+			   << ((elapsed > 0.0) ? stream->mFrames/elapsed : 0.0) << ","
+			   << ((stream->mFrames > 0) ? stream->mBusyTicks*1000.0/tick_frequency/stream->mFrames : 0.0) << ","
+			   << stream->mDetections << endl;
+		total_frames += stream->mFrames;
+	}
+	double elapsed = ((double) (mEndTicks-mStartTicks))/tick_frequency;
+	output << "\"total\"," << total_frames << "," << ((elapsed > 0.0) ? total_frames/elapsed : 0.0) << ",," << endl;
+}
+
+bool MultiStreamRunner::exportResults( String filename )
+{
+	ofstream output(filename.c_str());
+	if (!output.is_open())
+	{
+		cout << "Could not open the results file for write: " << filename << endl;
+		return false;
+	}
+	writeResults(output);
+	return true;
+}
@@ -0,0 +1,171 @@
+#include <iostream>
+#include <functional>
+#include <stdio.h>
+
+#include "../CV Common/Utilities.h"
+
+using namespace std;
+
+// A fixed pool of worker threads, each with its own task queue.  Tasks
+// submitted from a worker go onto that worker's queue, and other tasks are
+// spread over the queues in turn.  A worker takes tasks from the front of its
+// own queue (so its tasks run in the order they were submitted) and, when that
+// is empty, steals from the back of the other workers' queues.
+class WorkStealingPool
+{
+private:
+	struct WorkerQueue {
+		deque<function<void()> > mTasks;
+		std::mutex mLock;
+	};
+	vector<WorkerQueue*> mQueues;
+	vector<std::thread> mWorkers;
+	int mNextQueue;
+	int mQueuedTasks;
+	int mOutstandingTasks;
+	int mTasksRun;
+	int mTasksStolen;
+	bool mStopping;
+	std::mutex mLock;
+	std::condition_variable mWorkAvailable;
+	std::condition_variable mAllDone;
+	pthread_key_t mWorkerKey;
+	bool TakeTask( int worker, function<void()>& task );
+	void RunWorker( int worker );
+public:
+	WorkStealingPool( int number_of_workers=0 );
+	~WorkStealingPool();
+	void Submit( function<void()> task );
+	void WaitUntilIdle();
+	int getNumberOfWorkers()
+	{
+		return (int) mWorkers.size();
+	}
+	String getString();
+};
+
+// By default there is one worker for each hardware thread
+WorkStealingPool::WorkStealingPool( int number_of_workers )
+{
+	if (number_of_workers <= 0)
+		number_of_workers = std::max(1, (int) std::thread::hardware_concurrency());
+	mNextQueue = 0;
+	mQueuedTasks = 0;
+	mOutstandingTasks = 0;
+	mTasksRun = 0;
+	mTasksStolen = 0;
+	mStopping = false;
+	pthread_key_create(&mWorkerKey, NULL);
+	for (int worker=0; worker < number_of_workers; worker++)
+		mQueues.push_back(new WorkerQueue());
+	for (int worker=0; worker < number_of_workers; worker++)
+		mWorkers.push_back(std::thread(&WorkStealingPool::RunWorker, this, worker));
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		mStopping = true;
+	}
+	mWorkAvailable.notify_all();
+	for (int worker=0; worker < (int) mWorkers.size(); worker++)
+		mWorkers[worker].join();
+	for (int worker=0; worker < (int) mQueues.size(); worker++)
+		delete mQueues[worker];
+	pthread_key_delete(mWorkerKey);
+}
+
+void WorkStealingPool::Submit( function<void()> task )
+{
+	// the worker key holds the worker index plus one, so it is NULL on
+	// threads outside the pool
+	intptr_t worker = (intptr_t) pthread_getspecific(mWorkerKey) - 1;
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		mQueuedTasks++;
+		mOutstandingTasks++;
+		if (worker < 0)
+		{
+			worker = mNextQueue;
+			mNextQueue = (mNextQueue+1) % (int) mQueues.size();
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(mQueues[worker]->mLock);
+		mQueues[worker]->mTasks.push_back(task);
+	}
+	mWorkAvailable.notify_one();
+}
+
+bool WorkStealingPool::TakeTask( int worker, function<void()>& task )
+{
+	bool stolen = false;
+	bool found = false;
+	{
+		std::lock_guard<std::mutex> lock(mQueues[worker]->mLock);
+		if (!mQueues[worker]->mTasks.empty())
+		{
+			task = mQueues[worker]->mTasks.front();
+			mQueues[worker]->mTasks.pop_front();
+			found = true;
+		}
+	}
+	for (int offset=1; !found && offset < (int) mQueues.size(); offset++)
+	{
+		WorkerQueue* victim = mQueues[(worker+offset) % mQueues.size()];
+		std::lock_guard<std::mutex> lock(victim->mLock);
+		if (!victim->mTasks.empty())
+		{
+			task = victim->mTasks.back();
+			victim->mTasks.pop_back();
+			found = stolen = true;
+		}
+	}
+	if (found)
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		mQueuedTasks--;
+		if (stolen)
+			mTasksStolen++;
+	}
+	return found;
+}
+
+void WorkStealingPool::RunWorker( int worker )
+{
+	pthread_setspecific(mWorkerKey, (void*) (intptr_t) (worker+1));
+	for (;;)
+	{
+		function<void()> task;
+		if (!TakeTask(worker, task))
+		{
+			std::unique_lock<std::mutex> lock(mLock);
+			mWorkAvailable.wait(lock, [this] { return mQueuedTasks > 0 || mStopping; });
+			if (mStopping && mQueuedTasks == 0)
+				return;
+			continue;
+		}
+		task();
+		std::lock_guard<std::mutex> lock(mLock);
+		mTasksRun++;
+		if (--mOutstandingTasks == 0)
+			mAllDone.notify_all();
+	}
+}
+
+// Waits until every submitted task, including any submitted by running tasks,
+// has finished
+void WorkStealingPool::WaitUntilIdle()
+{
+	std::unique_lock<std::mutex> lock(mLock);
+	mAllDone.wait(lock, [this] { return mOutstandingTasks == 0; });
+}
+
+String WorkStealingPool::getString()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	std::ostringstream temp;
+	temp << "Scheduler: " << mWorkers.size() << " workers, " << mTasksRun << " tasks, " << mTasksStolen << " stolen";
+	return temp.str();
+}
@@ -1,136 +1,949 @@
-/*
- * This code is provided as part of "A Practical Introduction to Computer Vision with OpenCV"
- * by Kenneth Dawson-Howe � Wiley & Sons Inc. 2014.  All rights reserved.
- */
-#include "Utilities.h"
-#include "opencv2/video.hpp"
-
-void drawOpticalFlow(Mat& optical_flow, Mat& display, int spacing, Scalar passed_line_colour=-1.0, Scalar passed_point_colour=-1.0)
-{
-	Scalar colour( rand()&0xFF, rand()&0xFF, rand()&0xFF );
-    for (int row = spacing/2; row < display.rows; row += spacing)
-        for(int column = spacing/2; column < display.cols; column += spacing)
-        {
-            const Point2f& fxy = optical_flow.at<Point2f>(row,column);
-            circle(display, Point(column,row), 1, (passed_point_colour.val[0] == -1.0) ? colour : passed_point_colour, -1);
-            line(display, Point(column,row), Point(cvRound(column+fxy.x), cvRound(row+fxy.y)),
-                 (passed_line_colour.val[0] == -1.0) ? colour : passed_line_colour);
-        }
-}
-
-#define MAX_FEATURES 400
-void LucasKanadeOpticalFlow(Mat& previous_gray_frame, Mat& gray_frame, Mat& display_image)
-{
-	Size img_sz = previous_gray_frame.size();
-	int win_size = 10;
-	cvtColor(previous_gray_frame, display_image, CV_GRAY2BGR);
-	vector<Point2f> previous_features, current_features;
-	const int MAX_CORNERS = 500;
-	goodFeaturesToTrack(previous_gray_frame, previous_features, MAX_CORNERS, 0.05, 5, noArray(), 3, false, 0.04);
-	cornerSubPix(previous_gray_frame, previous_features, Size(win_size, win_size), Size(-1,-1),
-                 TermCriteria(CV_TERMCRIT_ITER|CV_TERMCRIT_EPS,20,0.03));
-    vector<uchar> features_found;
-	calcOpticalFlowPyrLK(previous_gray_frame, gray_frame, previous_features, current_features, features_found, noArray(),
-                         Size(win_size*4+1,win_size*4+1), 5,
-                         TermCriteria( CV_TERMCRIT_ITER | CV_TERMCRIT_EPS, 20, .3 ));
-    for( int i = 0; i < (int)previous_features.size(); i++ )
-	{
-		if( !features_found[i] )
-			continue;
-        circle(display_image, previous_features[i], 1, Scalar(0,0,255));
-		line(display_image, previous_features[i], current_features[i], Scalar(0,255,0));   
-	}
-}
-
-class MedianBackground
-{
-private:
-	Mat mMedianBackground;
-	float**** mHistogram;
-	float*** mLessThanMedian;
-	float mAgingRate;
-	float mCurrentAge;
-	float mTotalAges;
-	int mValuesPerBin;
-	int mNumberOfBins;
-public:
-	MedianBackground( Mat initial_image, float aging_rate, int values_per_bin );
-	Mat GetBackgroundImage();
-	void UpdateBackground( Mat current_frame );
-	float getAgingRate()
-	{
-		return mAgingRate;
-	}
-};
-
-MedianBackground::MedianBackground( Mat initial_image, float aging_rate, int values_per_bin )
-{
-	mCurrentAge = 1.0;
-	mAgingRate = aging_rate;
-	mTotalAges = 0.0;
-	mValuesPerBin = values_per_bin;
-	mNumberOfBins = 256/mValuesPerBin;
-	mMedianBackground = Mat::zeros(initial_image.size(), initial_image.type());
-	mLessThanMedian = (float***) new float**[mMedianBackground.rows];
-	mHistogram = (float****) new float***[mMedianBackground.rows];
-	for (int row=0; (row<mMedianBackground.rows); row++)
-	{
-		mHistogram[row] = (float***) new float**[mMedianBackground.cols];
-		mLessThanMedian[row] = (float**) new float*[mMedianBackground.cols];
-		for (int col=0; (col<mMedianBackground.cols); col++)
-		{
-			mHistogram[row][col] = (float**) new float*[mMedianBackground.channels()];
-			mLessThanMedian[row][col] = new float[mMedianBackground.channels()];
-			for (int ch=0; (ch<mMedianBackground.channels()); ch++)
-			{
-				mHistogram[row][col][ch] = new float[mNumberOfBins];
-				mLessThanMedian[row][col][ch] = 0.0;
-				for (int bin=0; (bin<mNumberOfBins); bin++)
-				{
-					mHistogram[row][col][ch][bin] = (float) 0.0;
-				}
-			}
-		}
-	}
-}
-
-Mat MedianBackground::GetBackgroundImage()
-{
-	return mMedianBackground;
-}
-
-void MedianBackground::UpdateBackground( Mat current_frame )
-{
-	mTotalAges += mCurrentAge;
-	float total_divided_by_2 = mTotalAges/((float) 2.0);
-	for (int row=0; (row<mMedianBackground.rows); row++)
-	{
-		for (int col=0; (col<mMedianBackground.cols); col++)
-		{
-			for (int ch=0; (ch<mMedianBackground.channels()); ch++)
-			{
-				int new_value = (mMedianBackground.channels()==3) ? current_frame.at<Vec3b>(row,col)[ch] : current_frame.at<uchar>(row,col);
-				int median = (mMedianBackground.channels()==3) ? mMedianBackground.at<Vec3b>(row,col)[ch] : mMedianBackground.at<uchar>(row,col);
-				int bin = new_value/mValuesPerBin;
-				mHistogram[row][col][ch][bin] += mCurrentAge;
-				if (new_value < median)
-					mLessThanMedian[row][col][ch] += mCurrentAge;
-				int median_bin = median/mValuesPerBin;
-				while ((mLessThanMedian[row][col][ch] + mHistogram[row][col][ch][median_bin] < total_divided_by_2) && (median_bin < 255))
-				{
-					mLessThanMedian[row][col][ch] += mHistogram[row][col][ch][median_bin];
-					median_bin++;
-				}
-				while ((mLessThanMedian[row][col][ch] > total_divided_by_2) && (median_bin > 0))
-				{
-					median_bin--;
-					mLessThanMedian[row][col][ch] -= mHistogram[row][col][ch][median_bin];
-				}
-				if (mMedianBackground.channels()==3)
-					mMedianBackground.at<Vec3b>(row,col)[ch] = median_bin*mValuesPerBin;
-				else mMedianBackground.at<uchar>(row,col) = median_bin*mValuesPerBin;
-			}
-		}
-	}
-	mCurrentAge *= mAgingRate;
-}
+/*
+ * This code is provided as part of "A Practical Introduction to Computer Vision with OpenCV"
+ * by Kenneth Dawson-Howe � Wiley & Sons Inc. 2014.  All rights reserved.
+ */
+#include "../CV Common/Utilities.h"
+#include "opencv2/video.hpp"
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+void drawOpticalFlow(Mat& optical_flow, Mat& display, int spacing, Scalar passed_line_colour=-1.0, Scalar passed_point_colour=-1.0)
+{
+	Scalar colour( rand()&0xFF, rand()&0xFF, rand()&0xFF );
+    for (int row = spacing/2; row < display.rows; row += spacing)
+        for(int column = spacing/2; column < display.cols; column += spacing)
+        {
+            const Point2f& fxy = optical_flow.at<Point2f>(row,column);
+            circle(display, Point(column,row), 1, (passed_point_colour.val[0] == -1.0) ? colour : passed_point_colour, -1);
+            line(display, Point(column,row), Point(cvRound(column+fxy.x), cvRound(row+fxy.y)),
+                 (passed_line_colour.val[0] == -1.0) ? colour : passed_line_colour);
+        }
+}
+
+#define MAX_FEATURES 400
+void LucasKanadeOpticalFlow(Mat& previous_gray_frame, Mat& gray_frame, Mat& display_image)
+{
+	Size img_sz = previous_gray_frame.size();
+	int win_size = 10;
+	cvtColor(previous_gray_frame, display_image, CV_GRAY2BGR);
+	vector<Point2f> previous_features, current_features;
+	const int MAX_CORNERS = 500;
+	goodFeaturesToTrack(previous_gray_frame, previous_features, MAX_CORNERS, 0.05, 5, noArray(), 3, false, 0.04);
+	cornerSubPix(previous_gray_frame, previous_features, Size(win_size, win_size), Size(-1,-1),
+                 TermCriteria(CV_TERMCRIT_ITER|CV_TERMCRIT_EPS,20,0.03));
+    vector<uchar> features_found;
+	calcOpticalFlowPyrLK(previous_gray_frame, gray_frame, previous_features, current_features, features_found, noArray(),
+                         Size(win_size*4+1,win_size*4+1), 5,
+                         TermCriteria( CV_TERMCRIT_ITER | CV_TERMCRIT_EPS, 20, .3 ));
+    for( int i = 0; i < (int)previous_features.size(); i++ )
+	{
+		if( !features_found[i] )
+			continue;
+        circle(display_image, previous_features[i], 1, Scalar(0,0,255));
+		line(display_image, previous_features[i], current_features[i], Scalar(0,255,0));   
+	}
+}
+
+// Lucas-Kanade tracking which persists between frames.  The pyramid of the
+// previous frame and its surviving features are kept, so each call only builds
+// the pyramid of the new frame, and features are only re-detected in the cells
+// of a grid over the image which no longer contain any tracked feature.
+#define TRACKER_WINDOW_SIZE 10
+#define TRACKER_PYRAMID_LEVELS 5
+#define TRACKER_GRID_CELLS 8
+class FeatureTracker
+{
+private:
+	vector<Mat> mPreviousPyramid;
+	vector<Mat> mCurrentPyramid;
+	vector<Point2f> mFeatures;
+	Mat mDetectionMask;
+	int mMaximumFeatures;
+	int mGridCells;
+	Timestamper mTimer;
+	int mPyramidEvent;
+	int mFlowEvent;
+	int mDetectionEvent;
+	double mLastTrackingTime;
+	int mLastDetectedFeatures;
+	void DetectFeatures( Mat& gray_frame );
+public:
+	FeatureTracker( int maximum_features=500, int grid_cells=TRACKER_GRID_CELLS );
+	void Reset();
+	void Track( Mat& gray_frame, vector<Point2f>& previous_features, vector<Point2f>& current_features );
+	vector<Point2f>& getFeatures()
+	{
+		return mFeatures;
+	}
+	// Total time (ms) taken by the last call to Track
+	double getLastTrackingTime()
+	{
+		return mLastTrackingTime;
+	}
+	// Number of features added by re-detection in the last call to Track
+	int getLastDetectedFeatures()
+	{
+		return mLastDetectedFeatures;
+	}
+	Timestamper& getTimer()
+	{
+		return mTimer;
+	}
+};
+
+FeatureTracker::FeatureTracker( int maximum_features, int grid_cells )
+{
+	mMaximumFeatures = maximum_features;
+	mGridCells = grid_cells;
+	mPyramidEvent = mTimer.registerEvent("Pyramid");
+	mFlowEvent = mTimer.registerEvent("Flow");
+	mDetectionEvent = mTimer.registerEvent("Detection");
+	Reset();
+}
+
+void FeatureTracker::Reset()
+{
+	mPreviousPyramid.clear();
+	mFeatures.clear();
+	mLastTrackingTime = 0.0;
+	mLastDetectedFeatures = 0;
+}
+
+void FeatureTracker::DetectFeatures( Mat& gray_frame )
+{
+	mLastDetectedFeatures = 0;
+	int features_wanted = mMaximumFeatures - (int) mFeatures.size();
+	if (features_wanted <= 0)
+		return;
+	// Only look for features in cells which have lost all of theirs
+	vector<int> cell_counts(mGridCells*mGridCells, 0);
+	for (int feature=0; feature < (int) mFeatures.size(); feature++)
+	{
+		int cell_column = std::min(mGridCells-1, std::max(0, (int) (mFeatures[feature].x*mGridCells/gray_frame.cols)));
+		int cell_row = std::min(mGridCells-1, std::max(0, (int) (mFeatures[feature].y*mGridCells/gray_frame.rows)));
+		cell_counts[cell_row*mGridCells+cell_column]++;
+	}
+	mDetectionMask.create(gray_frame.size(), CV_8UC1);
+	mDetectionMask.setTo(Scalar(0));
+	bool any_empty_cells = false;
+	for (int cell_row=0; cell_row < mGridCells; cell_row++)
+		for (int cell_column=0; cell_column < mGridCells; cell_column++)
+			if (cell_counts[cell_row*mGridCells+cell_column] == 0)
+			{
+				int left = cell_column*gray_frame.cols/mGridCells;
+				int top = cell_row*gray_frame.rows/mGridCells;
+				int right = (cell_column+1)*gray_frame.cols/mGridCells;
+				int bottom = (cell_row+1)*gray_frame.rows/mGridCells;
+				mDetectionMask(Rect(left, top, right-left, bottom-top)).setTo(Scalar(255));
+				any_empty_cells = true;
+			}
+	if (!any_empty_cells)
+		return;
+	vector<Point2f> new_features;
+	goodFeaturesToTrack(gray_frame, new_features, features_wanted, 0.05, 5, mDetectionMask, 3, false, 0.04);
+	if (new_features.empty())
+		return;
+	cornerSubPix(gray_frame, new_features, Size(TRACKER_WINDOW_SIZE, TRACKER_WINDOW_SIZE), Size(-1,-1),
+                 TermCriteria(CV_TERMCRIT_ITER|CV_TERMCRIT_EPS,20,0.03));
+	mFeatures.insert(mFeatures.end(), new_features.begin(), new_features.end());
+	mLastDetectedFeatures = (int) new_features.size();
+}
+
+// Returns the features which were tracked from the previous frame into this one
+// (none on the first call), then tops the feature set up for the next call.
+void FeatureTracker::Track( Mat& gray_frame, vector<Point2f>& previous_features, vector<Point2f>& current_features )
+{
+	TRACE_SCOPE("FeatureTracker::Track");
+	int64 start_ticks = getTickCount();
+	mTimer.ignoreTimeSinceLastRecorded();
+	Size window_size(TRACKER_WINDOW_SIZE*4+1, TRACKER_WINDOW_SIZE*4+1);
+	buildOpticalFlowPyramid(gray_frame, mCurrentPyramid, window_size, TRACKER_PYRAMID_LEVELS);
+	mTimer.recordTime(mPyramidEvent);
+
+	previous_features.clear();
+	current_features.clear();
+	if (!mPreviousPyramid.empty() && !mFeatures.empty())
+	{
+		vector<Point2f> tracked_features;
+		vector<uchar> features_found;
+		calcOpticalFlowPyrLK(mPreviousPyramid, mCurrentPyramid, mFeatures, tracked_features, features_found, noArray(),
+                             window_size, TRACKER_PYRAMID_LEVELS,
+                             TermCriteria( CV_TERMCRIT_ITER | CV_TERMCRIT_EPS, 20, .3 ));
+		// Keep only the features which were found and are still in the frame
+		Rect frame_area(0, 0, gray_frame.cols, gray_frame.rows);
+		int live_features = 0;
+		for (int feature=0; feature < (int) mFeatures.size(); feature++)
+		{
+			if (!features_found[feature] || !frame_area.contains(tracked_features[feature]))
+				continue;
+			previous_features.push_back(mFeatures[feature]);
+			current_features.push_back(tracked_features[feature]);
+			mFeatures[live_features++] = tracked_features[feature];
+		}
+		mFeatures.resize(live_features);
+	}
+	else mFeatures.clear();
+	mTimer.recordTime(mFlowEvent);
+
+	DetectFeatures(gray_frame);
+	mTimer.recordTime(mDetectionEvent);
+
+	// The current pyramid becomes the previous one; swapping keeps both sets of
+	// buffers allocated for the next frame
+	mPreviousPyramid.swap(mCurrentPyramid);
+	mLastTrackingTime = ((double) (getTickCount()-start_ticks))*1000.0/getTickFrequency();
+}
+
+void LucasKanadeOpticalFlow(FeatureTracker& tracker, Mat& gray_frame, Mat& display_image)
+{
+	cvtColor(gray_frame, display_image, CV_GRAY2BGR);
+	vector<Point2f> previous_features, current_features;
+	tracker.Track(gray_frame, previous_features, current_features);
+	for( int i = 0; i < (int)previous_features.size(); i++ )
+	{
+		circle(display_image, previous_features[i], 1, Scalar(0,0,255));
+		line(display_image, previous_features[i], current_features[i], Scalar(0,255,0));
+	}
+}
+
+// Interface to the background models used for detection.  Every backend takes
+// 8 or 16 bit images with 1 or 3 channels and produces a background image of
+// the same type; the aging rate controls how quickly each one adapts (see the
+// individual models).  Backends are created by name with CreateBackgroundModel.
+class BackgroundModel
+{
+public:
+	virtual ~BackgroundModel() {}
+	virtual Mat GetBackgroundImage()=0;
+	virtual void UpdateBackground( Mat current_frame )=0;
+	virtual void WriteState( vector<uchar>& state )=0;
+	virtual bool ReadState( const uchar* state, size_t size )=0;
+	// Bytes held by the model, including its background image
+	virtual size_t getMemoryUsage()=0;
+	virtual String getName()=0;
+	// Backends which can skip unchanging regions return true (see
+	// TypedMedianBackground::EnableChangeGating); the rest ignore it
+	virtual bool EnableChangeGating( int tile_size, int tolerance, int maximum_deferred_frames )
+	{
+		return false;
+	}
+	// Fraction of the image which was actually updated
+	virtual double getUpdatedFraction()
+	{
+		return 1.0;
+	}
+	bool RestoreCheckpoint( String filename );
+};
+
+// Restores the model from a checkpoint file, which is memory mapped rather than
+// read so that only the pages in use are touched.
+bool BackgroundModel::RestoreCheckpoint( String filename )
+{
+	int file = open(filename.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+	bool restored = false;
+	struct stat file_status;
+	if ((fstat(file, &file_status) == 0) && (file_status.st_size > 0))
+	{
+		size_t size = (size_t) file_status.st_size;
+		void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (mapping != MAP_FAILED)
+		{
+			restored = ReadState( (const uchar*) mapping, size );
+			munmap(mapping, size);
+		}
+	}
+	close(file);
+	if (!restored)
+		cout << "Could not restore the background model from: " << filename << endl;
+	return restored;
+}
+
+bool isSupportedBackgroundType( int type )
+{
+	return (type == CV_8UC1) || (type == CV_8UC3) || (type == CV_16UC1) || (type == CV_16UC3);
+}
+
+// Checkpoints of a median background start with this header, followed by the
+// median image, the less-than-median weights and then, for each value, the
+// range of histogram bins which are in use (first bin and number of bins as
+// uint32s) followed by the weights of those bins.  Most of each histogram is
+// empty, so storing only the occupied range keeps the files compact.  The
+// version must be changed whenever the layout changes.
+#define BACKGROUND_CHECKPOINT_MAGIC 0x4B434742   // "BGCK"
+#define BACKGROUND_CHECKPOINT_VERSION 1
+struct BackgroundCheckpointHeader {
+	uint32_t mMagic;
+	uint32_t mVersion;
+	int32_t mType;
+	int32_t mRows;
+	int32_t mColumns;
+	int32_t mValuesPerBin;
+	int32_t mNumberOfBins;
+	float mAgingRate;
+	float mCurrentAge;
+	float mTotalAges;
+};
+
+// Per-pixel histogram median background for images of ChannelType (uchar or
+// ushort) with NumberOfChannels channels.  The model is a template over the
+// pixel type so that none of the per-sample work has to check the image type
+// (CreateMedianBackground picks the instance from the initial image).  The
+// histograms and the less-than-median weights are held in single contiguous
+// arrays, ordered by row, column and channel, so the update walks them in step
+// with the image rows.
+template <typename ChannelType, int NumberOfChannels>
+class TypedMedianBackground : public BackgroundModel
+{
+private:
+	Mat mMedianBackground;
+	vector<float> mHistogram;
+	vector<float> mLessThanMedian;
+	float mAgingRate;
+	float mCurrentAge;
+	float mTotalAges;
+	int mValuesPerBin;
+	int mNumberOfBins;
+	// Change gating (see EnableChangeGating)
+	int mTileSize;
+	int mChangeTolerance;
+	int mMaximumDeferredFrames;
+	Mat mReferenceFrame;
+	vector<float> mDeferredWeight;
+	vector<int> mDeferredFrames;
+	int64 mTilesUpdated;
+	int64 mTilesDeferred;
+	void UpdateValues( Mat& samples, Rect region, float weight, float total_divided_by_2 );
+	bool TileChanged( Mat& current_frame, Rect tile );
+	void FlushDeferredUpdates();
+public:
+	TypedMedianBackground( Mat initial_image, float aging_rate, int values_per_bin );
+	Mat GetBackgroundImage()
+	{
+		return mMedianBackground;
+	}
+	void UpdateBackground( Mat current_frame );
+	float getAgingRate()
+	{
+		return mAgingRate;
+	}
+	void WriteState( vector<uchar>& state );
+	bool ReadState( const uchar* state, size_t size );
+	size_t getMemoryUsage()
+	{
+		return (mHistogram.size()+mLessThanMedian.size())*sizeof(float) +
+			   mMedianBackground.total()*mMedianBackground.elemSize() +
+			   mReferenceFrame.total()*mReferenceFrame.elemSize() +
+			   mDeferredWeight.size()*(sizeof(float)+sizeof(int));
+	}
+	String getName()
+	{
+		return "median";
+	}
+	bool EnableChangeGating( int tile_size, int tolerance, int maximum_deferred_frames );
+	double getUpdatedFraction()
+	{
+		return (mTilesUpdated+mTilesDeferred > 0) ? ((double) mTilesUpdated)/(mTilesUpdated+mTilesDeferred) : 1.0;
+	}
+};
+
+template <typename ChannelType, int NumberOfChannels>
+TypedMedianBackground<ChannelType,NumberOfChannels>::TypedMedianBackground( Mat initial_image, float aging_rate, int values_per_bin )
+{
+	int number_of_levels = 1 << (8*sizeof(ChannelType));
+	mCurrentAge = 1.0;
+	mAgingRate = aging_rate;
+	mTotalAges = 0.0;
+	mValuesPerBin = values_per_bin;
+	mNumberOfBins = (number_of_levels+mValuesPerBin-1)/mValuesPerBin;
+	mMedianBackground = Mat::zeros(initial_image.size(), initial_image.type());
+	size_t number_of_values = mMedianBackground.total()*NumberOfChannels;
+	mLessThanMedian.assign(number_of_values, 0.0f);
+	mHistogram.assign(number_of_values*mNumberOfBins, 0.0f);
+	mTileSize = 0;
+	mChangeTolerance = 0;
+	mMaximumDeferredFrames = 0;
+	mTilesUpdated = 0;
+	mTilesDeferred = 0;
+}
+
+// Adds weight to the bin of each sample in the region, and moves the medians of
+// those values to suit.
+template <typename ChannelType, int NumberOfChannels>
+void TypedMedianBackground<ChannelType,NumberOfChannels>::UpdateValues( Mat& samples, Rect region, float weight, float total_divided_by_2 )
+{
+	int values_in_region_row = region.width*NumberOfChannels;
+	int last_bin = mNumberOfBins-1;
+	for (int row=region.y; (row<region.y+region.height); row++)
+	{
+		size_t first_value = ((size_t) row*mMedianBackground.cols + region.x)*NumberOfChannels;
+		float* histogram = &mHistogram[first_value*mNumberOfBins];
+		float* less_than_median = &mLessThanMedian[first_value];
+		const ChannelType* new_values = samples.ptr<ChannelType>(row) + region.x*NumberOfChannels;
+		ChannelType* medians = mMedianBackground.ptr<ChannelType>(row) + region.x*NumberOfChannels;
+		for (int value=0; (value<values_in_region_row); value++)
+		{
+			int new_value = new_values[value];
+			int median = medians[value];
+			int bin = new_value/mValuesPerBin;
+			histogram[bin] += weight;
+			if (new_value < median)
+				*less_than_median += weight;
+			int median_bin = median/mValuesPerBin;
+			while ((*less_than_median + histogram[median_bin] < total_divided_by_2) && (median_bin < last_bin))
+			{
+				*less_than_median += histogram[median_bin];
+				median_bin++;
+			}
+			while ((*less_than_median > total_divided_by_2) && (median_bin > 0))
+			{
+				median_bin--;
+				*less_than_median -= histogram[median_bin];
+			}
+			medians[value] = (ChannelType) (median_bin*mValuesPerBin);
+			histogram += mNumberOfBins;
+			less_than_median++;
+		}
+	}
+}
+
+// A tile has changed if any value differs from the frame last applied to it
+// by more than the tolerance
+template <typename ChannelType, int NumberOfChannels>
+bool TypedMedianBackground<ChannelType,NumberOfChannels>::TileChanged( Mat& current_frame, Rect tile )
+{
+	int values_in_tile_row = tile.width*NumberOfChannels;
+	for (int row=tile.y; (row<tile.y+tile.height); row++)
+	{
+		const ChannelType* new_values = current_frame.ptr<ChannelType>(row) + tile.x*NumberOfChannels;
+		const ChannelType* old_values = mReferenceFrame.ptr<ChannelType>(row) + tile.x*NumberOfChannels;
+		int largest_difference = 0;
+		for (int value=0; (value<values_in_tile_row); value++)
+			largest_difference = std::max(largest_difference, std::abs((int) new_values[value] - (int) old_values[value]));
+		if (largest_difference > mChangeTolerance)
+			return true;
+	}
+	return false;
+}
+
+// Gated updates split the image into tile_size square tiles.  A tile whose
+// values are all within tolerance levels of the frame last applied to it is not
+// updated; instead its weight for the frame is deferred.  When the tile next
+// changes, or after maximum_deferred_frames frames, the total deferred weight
+// is added to the bins of the frame last applied and then the new frame is
+// applied as normal.  So every deferred sample is counted at a value within
+// tolerance levels of its true value (the same bin, or a neighbouring one,
+// when the tolerance is below the bin width), and the background image of an
+// unchanging tile lags by at most maximum_deferred_frames frames.  A tile size
+// of 0 turns gating off.
+template <typename ChannelType, int NumberOfChannels>
+bool TypedMedianBackground<ChannelType,NumberOfChannels>::EnableChangeGating( int tile_size, int tolerance, int maximum_deferred_frames )
+{
+	FlushDeferredUpdates();
+	mTileSize = std::max(0, tile_size);
+	mChangeTolerance = tolerance;
+	mMaximumDeferredFrames = maximum_deferred_frames;
+	mReferenceFrame.release();
+	int tile_count = 0;
+	if (mTileSize > 0)
+		tile_count = ((mMedianBackground.rows+mTileSize-1)/mTileSize) * ((mMedianBackground.cols+mTileSize-1)/mTileSize);
+	mDeferredWeight.assign(tile_count, 0.0f);
+	mDeferredFrames.assign(tile_count, 0);
+	return true;
+}
+
+// Applies all of the deferred weights, so the histograms are the same as if
+// every frame had been applied (within the tolerance)
+template <typename ChannelType, int NumberOfChannels>
+void TypedMedianBackground<ChannelType,NumberOfChannels>::FlushDeferredUpdates()
+{
+	if ((mTileSize <= 0) || mReferenceFrame.empty())
+		return;
+	float total_divided_by_2 = mTotalAges/((float) 2.0);
+	int tile = 0;
+	for (int tile_row=0; (tile_row<mMedianBackground.rows); tile_row += mTileSize)
+		for (int tile_column=0; (tile_column<mMedianBackground.cols); tile_column += mTileSize, tile++)
+			if (mDeferredFrames[tile] > 0)
+			{
+				Rect region(tile_column, tile_row, std::min(mTileSize, mMedianBackground.cols-tile_column),
+							std::min(mTileSize, mMedianBackground.rows-tile_row));
+				UpdateValues(mReferenceFrame, region, mDeferredWeight[tile], total_divided_by_2);
+				mDeferredWeight[tile] = 0.0f;
+				mDeferredFrames[tile] = 0;
+			}
+}
+
+template <typename ChannelType, int NumberOfChannels>
+void TypedMedianBackground<ChannelType,NumberOfChannels>::UpdateBackground( Mat current_frame )
+{
+	TRACE_SCOPE("MedianBackground::UpdateBackground");
+	CV_Assert( current_frame.type() == mMedianBackground.type() );
+	mTotalAges += mCurrentAge;
+	float total_divided_by_2 = mTotalAges/((float) 2.0);
+	if (mTileSize <= 0)
+		UpdateValues(current_frame, Rect(0, 0, mMedianBackground.cols, mMedianBackground.rows), mCurrentAge, total_divided_by_2);
+	else
+	{
+		// every tile of the first frame is applied
+		bool first_frame = mReferenceFrame.empty();
+		if (first_frame)
+			mReferenceFrame.create(mMedianBackground.size(), mMedianBackground.type());
+		int tile = 0;
+		for (int tile_row=0; (tile_row<mMedianBackground.rows); tile_row += mTileSize)
+			for (int tile_column=0; (tile_column<mMedianBackground.cols); tile_column += mTileSize, tile++)
+			{
+				Rect region(tile_column, tile_row, std::min(mTileSize, mMedianBackground.cols-tile_column),
+							std::min(mTileSize, mMedianBackground.rows-tile_row));
+				if (!first_frame && (mDeferredFrames[tile] < mMaximumDeferredFrames) && !TileChanged(current_frame, region))
+				{
+					mDeferredWeight[tile] += mCurrentAge;
+					mDeferredFrames[tile]++;
+					mTilesDeferred++;
+					continue;
+				}
+				if (mDeferredFrames[tile] > 0)
+					UpdateValues(mReferenceFrame, region, mDeferredWeight[tile], total_divided_by_2);
+				UpdateValues(current_frame, region, mCurrentAge, total_divided_by_2);
+				Mat reference_tile = mReferenceFrame(region);
+				current_frame(region).copyTo(reference_tile);
+				mDeferredWeight[tile] = 0.0f;
+				mDeferredFrames[tile] = 0;
+				mTilesUpdated++;
+			}
+	}
+	mCurrentAge *= mAgingRate;
+}
+
+template <typename ChannelType, int NumberOfChannels>
+void TypedMedianBackground<ChannelType,NumberOfChannels>::WriteState( vector<uchar>& state )
+{
+	TRACE_SCOPE("MedianBackground::WriteState");
+	// deferred weights aren't part of the checkpoint format, so apply them
+	FlushDeferredUpdates();
+	BackgroundCheckpointHeader header;
+	header.mMagic = BACKGROUND_CHECKPOINT_MAGIC;
+	header.mVersion = BACKGROUND_CHECKPOINT_VERSION;
+	header.mType = mMedianBackground.type();
+	header.mRows = mMedianBackground.rows;
+	header.mColumns = mMedianBackground.cols;
+	header.mValuesPerBin = mValuesPerBin;
+	header.mNumberOfBins = mNumberOfBins;
+	header.mAgingRate = mAgingRate;
+	header.mCurrentAge = mCurrentAge;
+	header.mTotalAges = mTotalAges;
+	size_t number_of_values = mLessThanMedian.size();
+	size_t row_bytes = mMedianBackground.cols*NumberOfChannels*sizeof(ChannelType);
+	state.clear();
+	state.reserve(sizeof(header) + number_of_values*(sizeof(ChannelType)+3*sizeof(float)+2*sizeof(uint32_t)));
+	state.insert(state.end(), (const uchar*) &header, (const uchar*) (&header+1));
+	for (int row=0; (row<mMedianBackground.rows); row++)
+		state.insert(state.end(), mMedianBackground.ptr(row), mMedianBackground.ptr(row)+row_bytes);
+	state.insert(state.end(), (const uchar*) &mLessThanMedian[0], (const uchar*) (&mLessThanMedian[0]+number_of_values));
+	const float* histogram = &mHistogram[0];
+	for (size_t value=0; (value<number_of_values); value++, histogram += mNumberOfBins)
+	{
+		uint32_t range[2] = { 0, 0 };
+		int first_bin = 0;
+		while ((first_bin < mNumberOfBins) && (histogram[first_bin] == 0.0f))
+			first_bin++;
+		if (first_bin < mNumberOfBins)
+		{
+			int last_bin = mNumberOfBins-1;
+			while (histogram[last_bin] == 0.0f)
+				last_bin--;
+			range[0] = first_bin;
+			range[1] = last_bin-first_bin+1;
+		}
+		state.insert(state.end(), (const uchar*) range, (const uchar*) (range+2));
+		state.insert(state.end(), (const uchar*) (histogram+range[0]), (const uchar*) (histogram+range[0]+range[1]));
+	}
+}
+
+// Replaces the model with a state written by WriteState.  The state is only
+// accepted if it is for the same image type and size and the same binning and
+// aging rate; otherwise the model is left as it was.
+template <typename ChannelType, int NumberOfChannels>
+bool TypedMedianBackground<ChannelType,NumberOfChannels>::ReadState( const uchar* state, size_t size )
+{
+	TRACE_SCOPE("MedianBackground::ReadState");
+	BackgroundCheckpointHeader header;
+	if (size < sizeof(header))
+		return false;
+	memcpy(&header, state, sizeof(header));
+	if ((header.mMagic != BACKGROUND_CHECKPOINT_MAGIC) || (header.mVersion != BACKGROUND_CHECKPOINT_VERSION) ||
+		(header.mType != mMedianBackground.type()) || (header.mRows != mMedianBackground.rows) ||
+		(header.mColumns != mMedianBackground.cols) || (header.mValuesPerBin != mValuesPerBin) ||
+		(header.mNumberOfBins != mNumberOfBins) || (header.mAgingRate != mAgingRate))
+		return false;
+	size_t number_of_values = mLessThanMedian.size();
+	size_t row_bytes = mMedianBackground.cols*NumberOfChannels*sizeof(ChannelType);
+	size_t fixed_bytes = sizeof(header) + row_bytes*mMedianBackground.rows + number_of_values*sizeof(float);
+	if (size < fixed_bytes)
+		return false;
+	// the histograms are decoded into a new array so that a truncated file
+	// leaves the current model untouched
+	vector<float> histograms(mHistogram.size(), 0.0f);
+	const uchar* ranges = state + fixed_bytes;
+	const uchar* end = state + size;
+	for (size_t value=0; (value<number_of_values); value++)
+	{
+		uint32_t range[2];
+		if (ranges + sizeof(range) > end)
+			return false;
+		memcpy(range, ranges, sizeof(range));
+		ranges += sizeof(range);
+		if ((range[0] + (size_t) range[1] > (size_t) mNumberOfBins) || (ranges + range[1]*sizeof(float) > end))
+			return false;
+		memcpy(&histograms[value*mNumberOfBins+range[0]], ranges, range[1]*sizeof(float));
+		ranges += range[1]*sizeof(float);
+	}
+	mHistogram.swap(histograms);
+	const uchar* medians = state + sizeof(header);
+	for (int row=0; (row<mMedianBackground.rows); row++, medians += row_bytes)
+		memcpy(mMedianBackground.ptr(row), medians, row_bytes);
+	memcpy(&mLessThanMedian[0], medians, number_of_values*sizeof(float));
+	mCurrentAge = header.mCurrentAge;
+	mTotalAges = header.mTotalAges;
+	// weights deferred before the restore belong to the old state
+	mReferenceFrame.release();
+	std::fill(mDeferredWeight.begin(), mDeferredWeight.end(), 0.0f);
+	std::fill(mDeferredFrames.begin(), mDeferredFrames.end(), 0);
+	return true;
+}
+
+// The constant memory models keep one float per value, and checkpoint it after
+// the same header as the median model.  Each model has its own magic number so
+// that one cannot be restored from another's checkpoint.
+#define FRUGAL_CHECKPOINT_MAGIC 0x4D464742    // "BGFM"
+#define AVERAGE_CHECKPOINT_MAGIC 0x41524742   // "BGRA"
+void WriteEstimateState( uint32_t magic, Mat& estimate, Mat& background, float rate, vector<uchar>& state )
+{
+	BackgroundCheckpointHeader header;
+	memset(&header, 0, sizeof(header));
+	header.mMagic = magic;
+	header.mVersion = BACKGROUND_CHECKPOINT_VERSION;
+	header.mType = background.type();
+	header.mRows = background.rows;
+	header.mColumns = background.cols;
+	header.mAgingRate = rate;
+	size_t row_bytes = estimate.cols*estimate.elemSize();
+	state.clear();
+	state.reserve(sizeof(header) + row_bytes*estimate.rows);
+	state.insert(state.end(), (const uchar*) &header, (const uchar*) (&header+1));
+	for (int row=0; (row<estimate.rows); row++)
+		state.insert(state.end(), estimate.ptr(row), estimate.ptr(row)+row_bytes);
+}
+
+bool ReadEstimateState( uint32_t magic, Mat& estimate, Mat& background, float rate, const uchar* state, size_t size )
+{
+	BackgroundCheckpointHeader header;
+	size_t row_bytes = estimate.cols*estimate.elemSize();
+	if (size != sizeof(header) + row_bytes*estimate.rows)
+		return false;
+	memcpy(&header, state, sizeof(header));
+	if ((header.mMagic != magic) || (header.mVersion != BACKGROUND_CHECKPOINT_VERSION) ||
+		(header.mType != background.type()) || (header.mRows != background.rows) ||
+		(header.mColumns != background.cols) || (header.mAgingRate != rate))
+		return false;
+	const uchar* values = state + sizeof(header);
+	for (int row=0; (row<estimate.rows); row++, values += row_bytes)
+		memcpy(estimate.ptr(row), values, row_bytes);
+	estimate.convertTo(background, background.type());
+	return true;
+}
+
+// Frugal streaming approximation of the median (Ma, Muthukrishnan & Sandler,
+// 2013).  Each value of the estimate steps towards the new sample by a fixed
+// amount, so it settles where as many samples fall above it as below.  This
+// needs one float per value rather than a histogram.  The step is
+// FRUGAL_STEP_SCALE*(aging_rate-1) levels (of an 8 bit image) per frame, which
+// gives the median model's aging rates similar adaptation times.
+#define FRUGAL_STEP_SCALE 150.0
+class FrugalMedianBackground : public BackgroundModel
+{
+private:
+	Mat mEstimate;
+	Mat mBackground;
+	float mAgingRate;
+	float mStep;
+	template <typename ChannelType> void UpdateEstimate( Mat& current_frame );
+public:
+	FrugalMedianBackground( Mat initial_image, float aging_rate );
+	Mat GetBackgroundImage()
+	{
+		return mBackground;
+	}
+	void UpdateBackground( Mat current_frame );
+	void WriteState( vector<uchar>& state )
+	{
+		WriteEstimateState( FRUGAL_CHECKPOINT_MAGIC, mEstimate, mBackground, mAgingRate, state );
+	}
+	bool ReadState( const uchar* state, size_t size )
+	{
+		return ReadEstimateState( FRUGAL_CHECKPOINT_MAGIC, mEstimate, mBackground, mAgingRate, state, size );
+	}
+	size_t getMemoryUsage()
+	{
+		return mEstimate.total()*mEstimate.elemSize() + mBackground.total()*mBackground.elemSize();
+	}
+	String getName()
+	{
+		return "frugal";
+	}
+};
+
+// The estimate starts from the initial image rather than from zero, so the
+// model is usable from the first frame
+FrugalMedianBackground::FrugalMedianBackground( Mat initial_image, float aging_rate )
+{
+	CV_Assert( isSupportedBackgroundType( initial_image.type() ) );
+	mAgingRate = aging_rate;
+	float levels_per_8_bit_level = (initial_image.depth() == CV_16U) ? 256.0f : 1.0f;
+	mStep = (float) (FRUGAL_STEP_SCALE*(aging_rate-1.0))*levels_per_8_bit_level;
+	initial_image.convertTo(mEstimate, CV_MAKETYPE(CV_32F, initial_image.channels()));
+	mBackground = initial_image.clone();
+}
+
+template <typename ChannelType>
+void FrugalMedianBackground::UpdateEstimate( Mat& current_frame )
+{
+	int values_on_each_row = mEstimate.cols*mEstimate.channels();
+	float step = mStep;
+	for (int row=0; (row<mEstimate.rows); row++)
+	{
+		const ChannelType* new_values = current_frame.ptr<ChannelType>(row);
+		float* estimates = mEstimate.ptr<float>(row);
+		ChannelType* background = mBackground.ptr<ChannelType>(row);
+		for (int value=0; (value<values_on_each_row); value++)
+		{
+			float new_value = (float) new_values[value];
+			float estimate = estimates[value];
+			// step towards the sample, without overshooting it
+			if (new_value > estimate)
+				estimate = std::min(estimate+step, new_value);
+			else if (new_value < estimate)
+				estimate = std::max(estimate-step, new_value);
+			estimates[value] = estimate;
+			background[value] = saturate_cast<ChannelType>(estimate);
+		}
+	}
+}
+
+void FrugalMedianBackground::UpdateBackground( Mat current_frame )
+{
+	TRACE_SCOPE("FrugalMedianBackground::UpdateBackground");
+	CV_Assert( current_frame.type() == mBackground.type() );
+	if (current_frame.depth() == CV_16U)
+		UpdateEstimate<ushort>( current_frame );
+	else UpdateEstimate<uchar>( current_frame );
+}
+
+// Exponentially weighted running average.  The median model weights each frame
+// aging_rate times more than the one before, so in the long run the newest
+// frame has 1-1/aging_rate of the total weight; the same weight is used here.
+class RunningAverageBackground : public BackgroundModel
+{
+private:
+	Mat mAverage;
+	Mat mBackground;
+	float mAgingRate;
+	double mWeight;
+public:
+	RunningAverageBackground( Mat initial_image, float aging_rate );
+	Mat GetBackgroundImage()
+	{
+		return mBackground;
+	}
+	void UpdateBackground( Mat current_frame );
+	void WriteState( vector<uchar>& state )
+	{
+		WriteEstimateState( AVERAGE_CHECKPOINT_MAGIC, mAverage, mBackground, mAgingRate, state );
+	}
+	bool ReadState( const uchar* state, size_t size )
+	{
+		return ReadEstimateState( AVERAGE_CHECKPOINT_MAGIC, mAverage, mBackground, mAgingRate, state, size );
+	}
+	size_t getMemoryUsage()
+	{
+		return mAverage.total()*mAverage.elemSize() + mBackground.total()*mBackground.elemSize();
+	}
+	String getName()
+	{
+		return "average";
+	}
+};
+
+RunningAverageBackground::RunningAverageBackground( Mat initial_image, float aging_rate )
+{
+	CV_Assert( isSupportedBackgroundType( initial_image.type() ) );
+	mAgingRate = aging_rate;
+	mWeight = 1.0 - 1.0/aging_rate;
+	initial_image.convertTo(mAverage, CV_MAKETYPE(CV_32F, initial_image.channels()));
+	mBackground = initial_image.clone();
+}
+
+void RunningAverageBackground::UpdateBackground( Mat current_frame )
+{
+	TRACE_SCOPE("RunningAverageBackground::UpdateBackground");
+	CV_Assert( current_frame.type() == mBackground.type() );
+	accumulateWeighted(current_frame, mAverage, mWeight);
+	mAverage.convertTo(mBackground, mBackground.type());
+}
+
+// Median background for 8 or 16 bit images with 1 or 3 channels.  The typed
+// model is chosen once, from the type of the initial image.
+Ptr<BackgroundModel> CreateMedianBackground( Mat initial_image, float aging_rate, int values_per_bin )
+{
+	switch (initial_image.type())
+	{
+	case CV_8UC1:
+		return Ptr<BackgroundModel>( new TypedMedianBackground<uchar,1>( initial_image, aging_rate, values_per_bin ) );
+	case CV_8UC3:
+		return Ptr<BackgroundModel>( new TypedMedianBackground<uchar,3>( initial_image, aging_rate, values_per_bin ) );
+	case CV_16UC1:
+		return Ptr<BackgroundModel>( new TypedMedianBackground<ushort,1>( initial_image, aging_rate, values_per_bin ) );
+	case CV_16UC3:
+		return Ptr<BackgroundModel>( new TypedMedianBackground<ushort,3>( initial_image, aging_rate, values_per_bin ) );
+	default:
+		cout << "MedianBackground only supports 8 or 16 bit images with 1 or 3 channels" << endl;
+		CV_Assert( false );
+	}
+	return Ptr<BackgroundModel>();
+}
+
+// Creates the background model called model_name ("median", "frugal" or
+// "average"), or returns an empty pointer if there is no such model.  The
+// values per bin are only used by the median model.
+Ptr<BackgroundModel> CreateBackgroundModel( String model_name, Mat initial_image, float aging_rate, int values_per_bin )
+{
+	if (model_name == "median")
+		return CreateMedianBackground( initial_image, aging_rate, values_per_bin );
+	else if (model_name == "frugal")
+		return Ptr<BackgroundModel>( new FrugalMedianBackground( initial_image, aging_rate ) );
+	else if (model_name == "average")
+		return Ptr<BackgroundModel>( new RunningAverageBackground( initial_image, aging_rate ) );
+	cout << "Unknown background model: " << model_name << " (expected median, frugal or average)" << endl;
+	return Ptr<BackgroundModel>();
+}
+
+// Writes checkpoints on a separate thread.  Each file is written under a
+// temporary name and then renamed, so a crash part way through a write leaves
+// the previous checkpoint intact.  If a newer state for the same file is
+// submitted before the previous one has been written, the older one is skipped.
+class CheckpointWriter
+{
+private:
+	map<String, vector<uchar> > mPendingStates;
+	int mCheckpointsWritten;
+	int mCheckpointsSkipped;
+	bool mClosing;
+	std::mutex mLock;
+	std::condition_variable mStatePending;
+	std::thread mWriterThread;
+	void WriteStates();
+	bool WriteFile( const String& filename, vector<uchar>& state );
+public:
+	CheckpointWriter();
+	~CheckpointWriter();
+	void Submit( String filename, vector<uchar>& state );
+	void Close();
+	String getString();
+};
+
+CheckpointWriter::CheckpointWriter()
+{
+	mCheckpointsWritten = 0;
+	mCheckpointsSkipped = 0;
+	mClosing = false;
+	mWriterThread = std::thread(&CheckpointWriter::WriteStates, this);
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+	Close();
+}
+
+// Takes the contents of state (which is left empty)
+void CheckpointWriter::Submit( String filename, vector<uchar>& state )
+{
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		vector<uchar>& pending_state = mPendingStates[filename];
+		if (!pending_state.empty())
+			mCheckpointsSkipped++;
+		pending_state.swap(state);
+		state.clear();
+	}
+	mStatePending.notify_one();
+}
+
+void CheckpointWriter::WriteStates()
+{
+	for (;;)
+	{
+		String filename;
+		vector<uchar> state;
+		{
+			std::unique_lock<std::mutex> lock(mLock);
+			mStatePending.wait(lock, [this] { return !mPendingStates.empty() || mClosing; });
+			if (mPendingStates.empty())
+				return;
+			filename = mPendingStates.begin()->first;
+			state.swap(mPendingStates.begin()->second);
+			mPendingStates.erase(mPendingStates.begin());
+		}
+		bool written = WriteFile(filename, state);
+		std::lock_guard<std::mutex> lock(mLock);
+		if (written)
+			mCheckpointsWritten++;
+	}
+}
+
+bool CheckpointWriter::WriteFile( const String& filename, vector<uchar>& state )
+{
+	TRACE_SCOPE("CheckpointWriter::WriteFile");
+	String temporary_filename = filename + ".tmp";
+	FILE* file = fopen(temporary_filename.c_str(), "wb");
+	if (file == NULL)
+	{
+		cout << "Could not open the checkpoint for write: " << temporary_filename << endl;
+		return false;
+	}
+	bool written = (fwrite(&state[0], 1, state.size(), file) == state.size()) &&
+				   (fflush(file) == 0) && (fsync(fileno(file)) == 0);
+	written = (fclose(file) == 0) && written;
+	if (!written || (rename(temporary_filename.c_str(), filename.c_str()) != 0))
+	{
+		cout << "Could not write the checkpoint: " << filename << endl;
+		remove(temporary_filename.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Writes any states still pending before returning
+void CheckpointWriter::Close()
+{
+	if (mWriterThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			mClosing = true;
+		}
+		mStatePending.notify_one();
+		mWriterThread.join();
+	}
+}
+
+String CheckpointWriter::getString()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	std::ostringstream temp;
+	temp << "Checkpoints: " << mCheckpointsWritten << " written, " << mCheckpointsSkipped << " skipped";
+	return temp.str();
+}
@@ -5,118 +5,179 @@
 #include <iostream>
 #include <stdio.h>
 
-#include "Video.cpp"
+#include "MultiStream.cpp"
+#include "ClipRecorder.cpp"
+#include "../CV Common/Utilities.cpp"
 
 using namespace cv;
 using namespace std;
 
-
-CvRect cropBlackBorder(Mat img) {
-	int startx = -1, endx = -1, starty = -1, endy = -1;
-	for (int i = 0; i < img.cols; i++) {
-		for (int j = 0; j < img.rows; j++) {
-			uchar pval = img.at<uchar>(j,i);
-			if (pval > 0) {
-				if (startx == -1)
-					startx = i;
-				if (starty == -1 || starty > j)
-					starty = j;
-				if (j > endy)
-					endy = j;
-				if (i > endx)
-					endx = i;
-			}
-		}
-	}
-	
-	// add 10px padding on each side, if possible
-	if (startx >= 10)
-		startx -= 10;
-	if (starty >= 10)
-		starty -= 10;
-	if (endx <= img.cols-10)
-		endx += 10;
-	if (endy <= img.rows-10)
-		endy += 10;
-	
-	CvRect rect(startx, starty, endx-startx, endy-starty);
-	return rect;
+/**
+ * Run the detector on every source in a list file within this process,
+ * sharing one thread pool, and print the throughput of each stream.
+ * @param list_file file with one video source per line
+ * @param results_file csv file for the per-stream results (optional)
+ * @param workers number of worker threads, 0 for one per core
+ * @param frames maximum frames to process per stream, 0 for all
+ * @param model_name background model backend for every stream
+ * @param gate only update the changing tiles of the backgrounds
+ * @return 0 on success
+ */
+int runStreams(string list_file, string results_file, int workers, int frames, string model_name, bool gate) {
+	vector<String> sources = readSourceList(list_file);
+	if (sources.empty())
+		return -1;
+	MultiStreamRunner runner(sources, workers, frames, model_name, gate);
+	runner.Run();
+	runner.writeResults(cout);
+	if (!results_file.empty())
+		runner.exportResults(results_file);
+	return 0;
 }
 
-// remove noise that's not part of the bag
-Mat cleanNoise(Mat img) {
-	Mat res;
-	erode(img, res, Mat());
-	erode(res, res, Mat());
-	dilate(res, res, Mat());
-	return res;
+/**
+ * Decode a video once and record its frames into a raw frame file, which can
+ * then be replayed (anywhere a video is accepted) without any decoding.
+ * @param video_file video to decode
+ * @param raw_file raw frame file to write
+ * @param frames maximum number of frames to record, 0 for all
+ * @return 0 on success
+ */
+int recordRawFrames(string video_file, string raw_file, int frames) {
+	FrameSource source(video_file);
+	Mat frame;
+	if (!source.isOpened() || !source.read(frame)) {
+		cout << "Could not read the video " << video_file << endl;
+		return -1;
+	}
+	RawFrameWriter writer;
+	if (!writer.Open(raw_file, frame.size(), frame.type(), source.getFPS(), source.getFourCC()))
+		return -1;
+	do {
+		if (!writer.Write(frame))
+			return -1;
+	} while ((frames <= 0 || writer.getFrameCount() < frames) && source.read(frame));
+	writer.Close();
+	cout << "Recorded " << writer.getFrameCount() << " frames of " << frame.cols << "x" << frame.rows
+		 << " to " << raw_file << endl;
+	return 0;
 }
 
 int main(int argc, char* argv[]) {
-	VideoCapture cap("/Users/Conor/Documents/College/CS4053/labs/labs/CV Lab 4/video/ObjectAbandonmentAndRemoval1.avi");
+	// usage: [options] [video file] [timings.json|timings.csv] [trace.json] [output video] [clip directory] [checkpoint prefix]
+	//    or: [options] -streams sources.txt [results.csv] [workers] [frames per stream]
+	//    or: -record video_file raw_file [frames]
+	// any video file can also be a raw frame file made by -record
+	// options: -model median|frugal|average, -gate (only update changing tiles)
+	string model_name = "median";
+	bool gate = false;
+	while (argc > 1) {
+		if (argc > 2 && string(argv[1]) == "-model") {
+			model_name = argv[2];
+			argc -= 2;
+			argv += 2;
+		} else if (string(argv[1]) == "-gate") {
+			gate = true;
+			argc--;
+			argv++;
+		} else break;
+	}
+	if (argc > 3 && string(argv[1]) == "-record")
+		return recordRawFrames(argv[2], argv[3], (argc > 4) ? atoi(argv[4]) : 0);
+	if (argc > 2 && string(argv[1]) == "-streams") {
+		return runStreams(argv[2], (argc > 3) ? argv[3] : "",
+						  (argc > 4) ? atoi(argv[4]) : 0, (argc > 5) ? atoi(argv[5]) : 0, model_name, gate);
+	}
+	
+	string video_file = (argc > 1) ? argv[1] : "/Users/Conor/Documents/College/CS4053/labs/labs/CV Lab 4/video/ObjectAbandonmentAndRemoval1.avi";
+	string timings_file = (argc > 2) ? argv[2] : "";
+	string trace_file = (argc > 3) ? argv[3] : "";
+	string output_file = (argc > 4) ? argv[4] : "";
+	string clip_directory = (argc > 5) ? argv[5] : "";
+	string checkpoint_prefix = (argc > 6) ? argv[6] : "";
+	FrameSource cap(video_file);
 	if(!cap.isOpened())
 		return -1;
 	
-	Mat edges;
 	namedWindow("Video",1);
 	namedWindow("Median",1);
-	Mat frame, mbframe1, mbframe2, diff, tdiff;
+	Mat frame;
 	cap.read(frame);
-	Rect r, finalr;
-	bool isRectValid = false, isRectFinal = false;
-	int finalCount = 0;
-	MedianBackground medianBackground1(frame, 1.009, 4);
-	MedianBackground medianBackground2(frame, 1.005, 4);
+	Timestamper timer;
+	int read_event = timer.registerEvent("Read");
+	AbandonmentDetector detector(frame, &timer, model_name);
+	if (gate)
+		detector.EnableChangeGating();
+	// start from the last saved background models rather than from scratch
+	if (!checkpoint_prefix.empty()) {
+		if (detector.RestoreCheckpoint(checkpoint_prefix))
+			cout << "Restored background models from " << checkpoint_prefix << endl;
+		detector.EnableCheckpoints(checkpoint_prefix);
+	}
+	int display_event = timer.registerEvent("Display");
+	// annotated frames are encoded on a separate thread so analysis isn't held up
+	AsyncVideoWriter output_video;
+	if (!output_file.empty())
+		output_video.Open(output_file, cap.getFourCC(), cap.getFrameSize(), cap.getFPS());
+	int write_event = timer.registerEvent("Write");
+	// keep a few seconds of pre-roll so each detection can be saved as a clip
+	EventClipRecorder* clips = NULL;
+	if (!clip_directory.empty())
+		clips = new EventClipRecorder(clip_directory, cap.getFPS());
+	int clip_event = timer.registerEvent("Clip");
+	int frame_number = 0;
+	bool was_detecting = false;
 	while(cap.read(frame)) {
-		// get current median frame and update based on current frame
-		mbframe1 = medianBackground1.GetBackgroundImage();
-		mbframe2 = medianBackground2.GetBackgroundImage();
-		medianBackground1.UpdateBackground(frame);
-		medianBackground2.UpdateBackground(frame);
-		
-		// get the absolute difference of the two different background models
-		absdiff(mbframe1, mbframe2, diff);
-		
-		cvtColor(diff, diff, CV_BGR2GRAY);
-		threshold(diff, tdiff, 50, 255, THRESH_BINARY);
+		frame_number++;
+		timer.recordTime(read_event);
 		
-		// try to clean some of the noise not related to the moving obejct
-		Mat total_diff = cleanNoise(tdiff);
-
-		if (countNonZero(total_diff) > 0) {
-			Rect newr = cropBlackBorder(total_diff);
-			if (!isRectValid) {
-				// begin rectangle size tracking
-				isRectValid = true;
-				r = newr;
-			} else {
-				// keep growing the rectangle until it starts shrinking, then
-				// maintain the max size it held
-				if (newr.area() > r.area()) {
-					r = newr;
-				} else {
-					finalr = r;
-					isRectFinal = true;
-				}
-			}
-		} else {
-			// reset rectangle size tracking
-			isRectValid = false;
+		// display the tracked rectangle while the detector reports it
+		bool detecting = detector.ProcessFrame(frame);
+		// frames replayed from a raw frame file are read only
+		if (detecting) {
+			if (cap.isZeroCopy())
+				frame = frame.clone();
+			rectangle(frame, detector.getDetection(), Scalar(0,0,255), 4);
 		}
 		
-		// display the tracked rectangle for 40 frames
-		if (isRectFinal && finalCount < 40) {
-			rectangle(frame, finalr, Scalar(0,0,255), 4);
-			finalCount++;
-		} else {
-			isRectFinal = false;
-			finalCount = 0;
+		// a new detection starts a clip which includes this frame
+		if (clips) {
+			if (detecting && !was_detecting)
+				clips->TriggerEvent(detector.getDetection(), frame_number);
+			clips->AddFrame(frame, frame_number);
+			timer.recordTime(clip_event);
 		}
+		was_detecting = detecting;
 		
 		imshow("Video", frame);
-		imshow("Median", total_diff);
+		imshow("Median", detector.getMask());
 		waitKey(1);
+		timer.recordTime(display_event);
+		
+		if (output_video.isOpened()) {
+			output_video.Write(frame);
+			timer.recordTime(write_event);
+		}
+	}
+	cout << detector.getFramePool().getString() << endl;
+	if (gate)
+		cout << "Background updated " << detector.getUpdatedFraction()*100.0 << "% of tiles" << endl;
+	if (!checkpoint_prefix.empty())
+		detector.SaveCheckpoint();
+	if (output_video.isOpened()) {
+		output_video.Close();
+		cout << output_video.getString() << endl;
+	}
+	if (clips) {
+		clips->Close();
+		cout << clips->getString() << endl;
+		delete clips;
 	}
-	// the camera will be deinitialized automatically in VideoCapture destructor
+	if (!timings_file.empty())
+		timer.exportTimes(timings_file);
+	// the trace is only populated in builds with ENABLE_TRACING defined
+	if (!trace_file.empty())
+		Tracer::exportChromeTrace(trace_file);
+	// the video will be released automatically in the FrameSource destructor
 	return 0;
 }